@@ -0,0 +1,288 @@
+#include "MockOllamaServer.h"
+#include "TranslatorEngine.h"
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+namespace {
+// Characters of output sent per streamed chunk (a few tokens, like a real server)
+const int kStreamChunkChars = 24;
+
+// Returns the JSON array that follows "Input:" in the prompt
+QJsonArray promptInput(const QString &prompt)
+{
+    int start = prompt.indexOf("Input:");
+    start = start < 0 ? -1 : prompt.indexOf('[', start);
+    if (start < 0) return QJsonArray();
+
+    int depth = 0;
+    bool inString = false;
+    bool escape = false;
+    for (int i = start; i < prompt.size(); ++i) {
+        const QChar ch = prompt.at(i);
+        if (inString) {
+            if (escape) escape = false;
+            else if (ch == '\\') escape = true;
+            else if (ch == '"') inString = false;
+        } else if (ch == '"') {
+            inString = true;
+        } else if (ch == '[') {
+            depth++;
+        } else if (ch == ']' && --depth == 0) {
+            return QJsonDocument::fromJson(prompt.mid(start, i - start + 1).toUtf8()).array();
+        }
+    }
+    return QJsonArray();
+}
+}
+
+MockOllamaServer::MockOllamaServer(const Options &options, QObject *parent)
+    : QObject(parent)
+    , m_options(options)
+    , m_random(options.seed)
+    , m_server(nullptr)
+    , m_activeSlots(0)
+    , m_requests(0)
+    , m_malformed(0)
+    , m_truncated(0)
+    , m_generatedTokens(0)
+{
+    m_options.slots = qMax(1, m_options.slots);
+}
+
+quint16 MockOllamaServer::listen()
+{
+    if (!m_server) {
+        m_server = new QTcpServer(this);
+        connect(m_server, &QTcpServer::newConnection, this, &MockOllamaServer::onNewConnection);
+    }
+    if (!m_server->isListening() && !m_server->listen(QHostAddress::LocalHost, 0)) {
+        return 0;
+    }
+    return m_server->serverPort();
+}
+
+void MockOllamaServer::close()
+{
+    if (m_server) m_server->close();
+    m_queue.clear();
+    for (QTcpSocket *socket : m_buffers.keys()) {
+        socket->abort();
+        socket->deleteLater();
+    }
+    m_buffers.clear();
+}
+
+void MockOllamaServer::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        m_buffers.insert(socket, QByteArray());
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_buffers.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MockOllamaServer::onReadyRead(QTcpSocket *socket)
+{
+    QByteArray &buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    // Keep-alive connections may carry several requests
+    for (;;) {
+        const int headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) return;
+
+        const QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+        const QList<QByteArray> requestLine = lines.value(0).trimmed().split(' ');
+        int contentLength = 0;
+        for (const QByteArray &line : lines) {
+            const int colon = line.indexOf(':');
+            if (colon > 0 && line.left(colon).trimmed().toLower() == "content-length") {
+                contentLength = line.mid(colon + 1).trimmed().toInt();
+            }
+        }
+        if (buffer.size() < headerEnd + 4 + contentLength) return;
+
+        const QByteArray body = buffer.mid(headerEnd + 4, contentLength);
+        buffer.remove(0, headerEnd + 4 + contentLength);
+        handleRequest(socket, requestLine.value(1), body);
+    }
+}
+
+void MockOllamaServer::handleRequest(QTcpSocket *socket, const QByteArray &path, const QByteArray &body)
+{
+    const bool chat = path == "/api/chat";
+    if (path != "/api/generate" && !chat) {
+        writeResponse(socket, 404, "text/plain", "404 page not found");
+        return;
+    }
+    QJsonParseError parseError;
+    const QJsonObject request = QJsonDocument::fromJson(body, &parseError).object();
+    if (parseError.error != QJsonParseError::NoError) {
+        writeResponse(socket, 400, "application/json", "{\"error\":\"invalid JSON in request body\"}");
+        return;
+    }
+    m_requests++;
+
+    QString prompt = request.value("prompt").toString();
+    int cachedTokens = 0;
+    if (chat) {
+        for (const QJsonValue &value : request.value("messages").toArray()) {
+            const QJsonObject message = value.toObject();
+            const QString content = message.value("content").toString();
+            if (message.value("role").toString() == "system") {
+                if (content == m_lastSystemPrompt) cachedTokens += TranslatorEngine::estimateTokens(content);
+                m_lastSystemPrompt = content;
+            }
+            prompt += content + '\n';
+        }
+    }
+    QJsonArray translations;
+    for (const QJsonValue &value : promptInput(prompt)) {
+        const QJsonObject input = value.toObject();
+        QJsonObject output;
+        output["id"] = input.value("id");
+        output["translation"] = "[mock] " + input.value("text").toString();
+        translations.append(output);
+    }
+    QJsonObject answer;
+    answer["translations"] = translations;
+
+    QSharedPointer<Generation> gen(new Generation);
+    gen->socket = socket;
+    gen->stream = request.value("stream").toBool(true);
+    gen->chat = chat;
+    gen->model = request.value("model").toString();
+    gen->response = QString::fromUtf8(QJsonDocument(answer).toJson(QJsonDocument::Compact));
+    gen->doneReason = "stop";
+    gen->promptTokens = qMax(1, TranslatorEngine::estimateTokens(prompt) - cachedTokens);
+
+    const double roll = m_random.generateDouble();
+    if (roll < m_options.malformedRate) {
+        // Broken JSON: an unterminated string in the middle of the answer
+        gen->response = gen->response.left(gen->response.size() / 2) + "\"\n<|im_end|>";
+        m_malformed++;
+    } else if (roll < m_options.malformedRate + m_options.truncationRate) {
+        // The model ran out of context
+        gen->response = gen->response.left(gen->response.size() * 3 / 5);
+        gen->doneReason = "length";
+        m_truncated++;
+    }
+    gen->evalTokens = TranslatorEngine::estimateTokens(gen->response);
+    m_generatedTokens += gen->evalTokens;
+
+    m_queue.enqueue(gen);
+    startNext();
+}
+
+void MockOllamaServer::startNext()
+{
+    while (m_activeSlots < m_options.slots && !m_queue.isEmpty()) {
+        QSharedPointer<Generation> gen = m_queue.dequeue();
+        if (!gen->socket) continue;   // Client gave up while queued
+        m_activeSlots++;
+
+        if (gen->stream) {
+            gen->socket->write("HTTP/1.1 200 OK\r\n"
+                               "Content-Type: application/x-ndjson\r\n"
+                               "Transfer-Encoding: chunked\r\n\r\n");
+            // The prompt is evaluated before the first token comes out
+            QTimer::singleShot(promptLatencyMs(gen->promptTokens), this, [this, gen]() { streamNext(gen); });
+        } else {
+            QTimer::singleShot(promptLatencyMs(gen->promptTokens) + latencyMs(gen->evalTokens), this, [this, gen]() {
+                if (gen->socket) {
+                    writeResponse(gen->socket, 200, "application/json", envelope(*gen, gen->response, true));
+                }
+                finishGeneration(gen);
+            });
+        }
+    }
+}
+
+void MockOllamaServer::streamNext(const QSharedPointer<Generation> &gen)
+{
+    const QString piece = gen->response.mid(gen->sent, kStreamChunkChars);
+    QTimer::singleShot(latencyMs(TranslatorEngine::estimateTokens(piece)), this, [this, gen, piece]() {
+        if (!gen->socket) {
+            finishGeneration(gen);
+            return;
+        }
+        gen->sent += piece.size();
+        const bool done = gen->sent >= gen->response.size();
+        writeChunk(gen->socket, envelope(*gen, piece, false) + '\n');
+        if (!done) {
+            streamNext(gen);
+            return;
+        }
+        writeChunk(gen->socket, envelope(*gen, QString(), true) + '\n');
+        writeChunk(gen->socket, QByteArray());
+        finishGeneration(gen);
+    });
+}
+
+void MockOllamaServer::finishGeneration(const QSharedPointer<Generation> &gen)
+{
+    Q_UNUSED(gen);
+    m_activeSlots--;
+    startNext();
+}
+
+void MockOllamaServer::writeResponse(QTcpSocket *socket, int status, const QByteArray &contentType, const QByteArray &body)
+{
+    const QByteArray reason = status == 200 ? "OK" : (status == 404 ? "Not Found" : "Bad Request");
+    socket->write("HTTP/1.1 " + QByteArray::number(status) + ' ' + reason + "\r\n"
+                  "Content-Type: " + contentType + "\r\n"
+                  "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n");
+    socket->write(body);
+}
+
+void MockOllamaServer::writeChunk(QTcpSocket *socket, const QByteArray &data)
+{
+    socket->write(QByteArray::number(data.size(), 16) + "\r\n" + data + "\r\n");
+}
+
+QByteArray MockOllamaServer::envelope(const Generation &gen, const QString &response, bool done) const
+{
+    QJsonObject obj;
+    obj["model"] = gen.model;
+    obj["created_at"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+    if (gen.chat) {
+        QJsonObject message;
+        message["role"] = "assistant";
+        message["content"] = response;
+        obj["message"] = message;
+    } else {
+        obj["response"] = response;
+    }
+    obj["done"] = done;
+    if (done) {
+        // Durations are in nanoseconds, as reported by Ollama
+        const qint64 promptNs = qint64(gen.promptTokens) * m_options.promptLatencyUs * 1000;
+        const qint64 evalNs = qint64(gen.evalTokens) * m_options.tokenLatencyUs * 1000;
+        obj["done_reason"] = gen.doneReason;
+        obj["total_duration"] = double(promptNs + evalNs);
+        obj["load_duration"] = 0;
+        obj["prompt_eval_count"] = gen.promptTokens;
+        obj["prompt_eval_duration"] = double(promptNs);
+        obj["eval_count"] = gen.evalTokens;
+        obj["eval_duration"] = double(evalNs);
+    }
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+int MockOllamaServer::latencyMs(int tokens) const
+{
+    return int(qint64(tokens) * m_options.tokenLatencyUs / 1000);
+}
+
+int MockOllamaServer::promptLatencyMs(int tokens) const
+{
+    return int(qint64(tokens) * m_options.promptLatencyUs / 1000);
+}
@@ -0,0 +1,90 @@
+#ifndef MOCKOLLAMASERVER_H
+#define MOCKOLLAMASERVER_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QRandomGenerator>
+#include <QSharedPointer>
+#include <atomic>
+
+class QTcpServer;
+class QTcpSocket;
+
+// Stand-in for Ollama's /api/generate and /api/chat used by the benchmark.
+//
+// Every item of the JSON array after "Input:" in the prompt is echoed back as a
+// translation, wrapped in the same envelope (and timing fields) as a real server.
+// For /api/chat a system message equal to the previous one counts as a prompt cache
+// hit: only the user message is reported in prompt_eval_count.
+// Generation time is simulated per output token, and at most `slots` requests are
+// generated at once (OLLAMA_NUM_PARALLEL); the rest wait in a queue. A share of the
+// answers can be made malformed or cut off with done_reason "length".
+//
+// The server is meant to live in its own QThread so that the simulated latency does
+// not block the engine; call listen() through a blocking queued connection.
+class MockOllamaServer : public QObject {
+    Q_OBJECT
+
+public:
+    struct Options {
+        int tokenLatencyUs = 200;      // Per generated token
+        int promptLatencyUs = 20;      // Per prompt token not served from the prompt cache
+        int slots = 4;                 // Requests generated in parallel
+        double malformedRate = 0.0;    // Share of answers that are not valid JSON
+        double truncationRate = 0.0;   // Share of answers cut off at the context limit
+        quint32 seed = 1;
+    };
+
+    explicit MockOllamaServer(const Options &options, QObject *parent = nullptr);
+
+    // Listens on localhost; returns the port or 0 on failure
+    Q_INVOKABLE quint16 listen();
+    Q_INVOKABLE void close();
+
+    int requestCount() const { return m_requests; }
+    int malformedCount() const { return m_malformed; }
+    int truncatedCount() const { return m_truncated; }
+    qint64 generatedTokens() const { return m_generatedTokens; }
+
+private:
+    struct Generation {
+        QPointer<QTcpSocket> socket;
+        bool stream = false;
+        bool chat = false;
+        QString model;
+        QString response;          // Full model output
+        QString doneReason;
+        int promptTokens = 0;
+        int evalTokens = 0;
+        int sent = 0;              // Characters of response already streamed
+    };
+
+    void onNewConnection();
+    void onReadyRead(QTcpSocket *socket);
+    void handleRequest(QTcpSocket *socket, const QByteArray &path, const QByteArray &body);
+    void startNext();
+    void streamNext(const QSharedPointer<Generation> &gen);
+    void finishGeneration(const QSharedPointer<Generation> &gen);
+    void writeResponse(QTcpSocket *socket, int status, const QByteArray &contentType, const QByteArray &body);
+    void writeChunk(QTcpSocket *socket, const QByteArray &data);
+    QByteArray envelope(const Generation &gen, const QString &response, bool done) const;
+    int latencyMs(int tokens) const;
+    int promptLatencyMs(int tokens) const;
+
+    Options m_options;
+    QRandomGenerator m_random;
+    QTcpServer *m_server;
+    QHash<QTcpSocket*, QByteArray> m_buffers;
+    QQueue<QSharedPointer<Generation>> m_queue;
+    QString m_lastSystemPrompt;
+    int m_activeSlots;
+
+    std::atomic<int> m_requests;
+    std::atomic<int> m_malformed;
+    std::atomic<int> m_truncated;
+    std::atomic<qint64> m_generatedTokens;
+};
+
+#endif // MOCKOLLAMASERVER_H
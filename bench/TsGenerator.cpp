@@ -0,0 +1,109 @@
+#include "TsGenerator.h"
+#include <QFile>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QXmlStreamWriter>
+
+namespace {
+const int kMessagesPerContext = 40;
+const int kFinishedPercent = 5;
+const int kRepeatPercent = 20;
+
+const char *const kWords[] = {
+    "file", "open", "save", "project", "settings", "network", "error", "window", "export", "import",
+    "selected", "items", "cannot", "connection", "server", "value", "default", "changes", "remove", "document",
+    "translation", "language", "model", "request", "timeout", "folder", "preview", "update", "current", "format"
+};
+const int kWordCount = int(sizeof(kWords) / sizeof(kWords[0]));
+
+QString words(QRandomGenerator &random, int count)
+{
+    QStringList list;
+    for (int i = 0; i < count; ++i) {
+        list.append(QString::fromLatin1(kWords[random.bounded(kWordCount)]));
+    }
+    QString text = list.join(' ');
+    text[0] = text[0].toUpper();
+    return text;
+}
+
+QString makeSource(QRandomGenerator &random)
+{
+    switch (random.bounded(6)) {
+    case 0: // Menu entry with a mnemonic
+        return "&" + words(random, 1 + random.bounded(2));
+    case 1: // Status message with placeholders
+        return words(random, 3 + random.bounded(4)) + " \"%1\" (%2)";
+    case 2: // Plural form
+        return QString("%n ") + words(random, 2 + random.bounded(3));
+    case 3: // Rich-text tooltip
+        return "<b>" + words(random, 2) + "</b><br/>" + words(random, 8 + random.bounded(16)) + " & more.";
+    case 4: // Long description
+        return words(random, 20 + random.bounded(40)) + ".";
+    default: // Button label
+        return words(random, 1 + random.bounded(3));
+    }
+}
+}
+
+bool TsGenerator::write(const QString &filePath, int messageCount, quint32 seed, QString *errorString)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errorString) *errorString = "Failed to save file: " + file.errorString();
+        return false;
+    }
+
+    QRandomGenerator random(seed);
+    QStringList sources;
+    sources.reserve(messageCount);
+
+    QXmlStreamWriter xml(&file);
+    xml.setAutoFormatting(true);
+    xml.setAutoFormattingIndent(4);
+    xml.writeStartDocument();
+    xml.writeDTD("<!DOCTYPE TS>");
+    xml.writeStartElement("TS");
+    xml.writeAttribute("version", "2.1");
+    xml.writeAttribute("language", "zh_CN");
+    xml.writeAttribute("sourcelanguage", "en");
+
+    for (int i = 0; i < messageCount; ++i) {
+        if (i % kMessagesPerContext == 0) {
+            if (i > 0) xml.writeEndElement(); // context
+            xml.writeStartElement("context");
+            xml.writeTextElement("name", QString("Widget%1").arg(i / kMessagesPerContext));
+        }
+
+        QString source;
+        if (!sources.isEmpty() && random.bounded(100) < kRepeatPercent) {
+            source = sources.at(random.bounded(sources.size()));
+        } else {
+            source = makeSource(random);
+            sources.append(source);
+        }
+
+        xml.writeStartElement("message");
+        xml.writeEmptyElement("location");
+        xml.writeAttribute("filename", QString("../src/widget%1.cpp").arg(i / kMessagesPerContext));
+        xml.writeAttribute("line", QString::number(10 + (i % kMessagesPerContext) * 7));
+        xml.writeTextElement("source", source);
+        xml.writeStartElement("translation");
+        if (random.bounded(100) < kFinishedPercent) {
+            xml.writeCharacters(source);
+        } else {
+            xml.writeAttribute("type", "unfinished");
+        }
+        xml.writeEndElement(); // translation
+        xml.writeEndElement(); // message
+    }
+    if (messageCount > 0) xml.writeEndElement(); // context
+    xml.writeEndElement(); // TS
+    xml.writeEndDocument();
+
+    if (xml.hasError() || !file.flush()) {
+        if (errorString) *errorString = "Failed to save file: " + file.errorString();
+        return false;
+    }
+    return true;
+}
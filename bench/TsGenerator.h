@@ -0,0 +1,14 @@
+#ifndef TSGENERATOR_H
+#define TSGENERATOR_H
+
+#include <QString>
+
+// Writes synthetic .ts files for the benchmark. The messages mimic a real UI
+// catalogue: short labels and longer tooltips, about one in five sources
+// repeated across contexts, %1 / %n placeholders, &mnemonics, rich-text markup
+// and XML entities. A small share is already finished.
+namespace TsGenerator {
+bool write(const QString &filePath, int messageCount, quint32 seed, QString *errorString = nullptr);
+}
+
+#endif // TSGENERATOR_H
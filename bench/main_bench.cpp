@@ -0,0 +1,177 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include "MockOllamaServer.h"
+#include "TranslatorEngine.h"
+#include "TsGenerator.h"
+
+// End-to-end throughput benchmark: generates synthetic .ts files and translates
+// them through TranslatorEngine against MockOllamaServer, so batching, concurrency
+// and parsing changes can be compared without a GPU-backed Ollama.
+// The translation memory, the checkpoint journal, the snapshots and fuzzy matching are
+// disabled: the generated finished messages copy their source, so local reuse would
+// resolve items without a request. Every unfinished item reaches the mock server.
+
+namespace {
+QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QString kilobytes(qint64 bytes)
+{
+    return QString::number(bytes / 1024.0, 'f', 1) + " KB";
+}
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("LLMTranslatorBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures TranslatorEngine throughput against a simulated Ollama server.");
+    parser.addHelpOption();
+
+    QCommandLineOption sizesOption("messages", "Comma-separated message counts of the generated files.", "counts", "1000,10000");
+    QCommandLineOption latencyOption("token-latency-us", "Simulated generation time per output token.", "us", "200");
+    QCommandLineOption promptLatencyOption("prompt-latency-us", "Simulated evaluation time per uncached prompt token.", "us", "20");
+    QCommandLineOption slotsOption("slots", "Requests the mock server generates in parallel.", "n", "4");
+    QCommandLineOption malformedOption("malformed-rate", "Share of answers that are not valid JSON (0..1).", "rate", "0");
+    QCommandLineOption truncationOption("truncation-rate", "Share of answers cut off at the context limit (0..1).", "rate", "0");
+    QCommandLineOption seedOption("seed", "Seed of the generator and the mock server.", "n", "1");
+    QCommandLineOption concurrencyOption({"j", "concurrency"}, "Concurrent batch requests.", "n", "4");
+    QCommandLineOption contextOption("context", "Model context window in tokens.", "tokens", "8192");
+    QCommandLineOption batchOption("batch-items", "Maximum items per batch.", "n", "200");
+    QCommandLineOption langOption({"l", "lang"}, "Comma-separated target languages.", "languages", "Chinese");
+    QCommandLineOption streamOption("stream", "Use streaming responses.");
+    QCommandLineOption prefixOption("prefix-cache", "Use /api/chat with a fixed system prompt.");
+    QCommandLineOption verboseOption({"v", "verbose"}, "Print the engine log.");
+    parser.addOptions({sizesOption, latencyOption, promptLatencyOption, slotsOption, malformedOption, truncationOption,
+                       seedOption, concurrencyOption, contextOption, batchOption, langOption, streamOption,
+                       prefixOption, verboseOption});
+    parser.process(app);
+
+    MockOllamaServer::Options mockOptions;
+    mockOptions.tokenLatencyUs = parser.value(latencyOption).toInt();
+    mockOptions.promptLatencyUs = parser.value(promptLatencyOption).toInt();
+    mockOptions.slots = parser.value(slotsOption).toInt();
+    mockOptions.malformedRate = parser.value(malformedOption).toDouble();
+    mockOptions.truncationRate = parser.value(truncationOption).toDouble();
+    mockOptions.seed = parser.value(seedOption).toUInt();
+
+    // The server runs in its own thread so simulated latency never blocks the engine
+    QThread serverThread;
+    MockOllamaServer *server = new MockOllamaServer(mockOptions);
+    server->moveToThread(&serverThread);
+    QObject::connect(&serverThread, &QThread::finished, server, &QObject::deleteLater);
+    serverThread.start();
+
+    quint16 port = 0;
+    QMetaObject::invokeMethod(server, "listen", Qt::BlockingQueuedConnection, Q_RETURN_ARG(quint16, port));
+    if (port == 0) {
+        out() << "Error: the mock server could not listen on localhost." << endl;
+        serverThread.quit();
+        serverThread.wait();
+        return 1;
+    }
+    const QString apiUrl = QString("http://127.0.0.1:%1/api/generate").arg(port);
+
+    QTemporaryDir tempDir;
+    QStringList languages;
+    for (const QString &lang : parser.value(langOption).split(',', QString::SkipEmptyParts)) {
+        languages.append(lang.trimmed());
+    }
+
+    TranslatorEngine engine;
+    engine.setTranslationMemoryEnabled(false);
+    engine.setJournalEnabled(false);
+    engine.setSnapshotEnabled(false);
+    engine.setFuzzyMatchingEnabled(false);
+    engine.setMaxConcurrency(parser.value(concurrencyOption).toInt());
+    engine.setContextSize(parser.value(contextOption).toInt());
+    engine.setMaxBatchItems(parser.value(batchOption).toInt());
+    engine.setStreamingEnabled(parser.isSet(streamOption));
+    engine.setPrefixCacheEnabled(parser.isSet(prefixOption));
+    if (parser.isSet(verboseOption)) {
+        engine.setLogLevel(TranslatorEngine::LogDebug);
+        QObject::connect(&engine, &TranslatorEngine::logMessage, [](const QString &msg) { out() << msg << endl; });
+    }
+    QObject::connect(&engine, &TranslatorEngine::errorOccurred, [](const QString &msg) {
+        out() << "ERROR: " << msg << endl;
+    });
+
+    int failures = 0;
+    for (const QString &size : parser.value(sizesOption).split(',', QString::SkipEmptyParts)) {
+        const int messages = size.trimmed().toInt();
+        const QString input = tempDir.filePath(QString("bench_%1.ts").arg(messages));
+        QString error;
+        if (messages <= 0 || !TsGenerator::write(input, messages, mockOptions.seed, &error)) {
+            out() << "Error: cannot generate " << size << " messages. " << error << endl;
+            failures++;
+            continue;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        if (!engine.loadFile(input)) {
+            failures++;
+            continue;
+        }
+        const qint64 loadMs = timer.elapsed();
+        const int requestsBefore = server->requestCount();
+        const int malformedBefore = server->malformedCount();
+        const int truncatedBefore = server->truncatedCount();
+
+        bool finished = false;
+        QEventLoop loop;
+        QMetaObject::Connection connection = QObject::connect(&engine, &TranslatorEngine::translationFinished, [&]() {
+            finished = true;
+            loop.quit();
+        });
+        engine.startTranslation(languages, apiUrl, "mock", false);
+        if (!finished) {
+            loop.exec();
+        }
+        QObject::disconnect(connection);
+        const TranslationStats stats = engine.runStats();
+        const MetricsCollector &metrics = engine.metrics();
+
+        timer.restart();
+        for (const QString &lang : languages) {
+            engine.saveFile(tempDir.filePath(QString("bench_%1_%2.ts").arg(messages).arg(lang)), lang);
+        }
+        const qint64 saveMs = timer.elapsed();
+
+        const int applied = stats.itemsTranslated + stats.itemsResolved;
+        out() << "== " << messages << " messages x " << languages.size() << " language(s)" << endl
+              << "  load             " << loadMs << " ms" << endl
+              << "  translate        " << stats.wallMs << " ms, "
+              << QString::number(applied * 1000.0 / qMax<qint64>(1, stats.wallMs), 'f', 1) << " items/s" << endl
+              << "  items            " << stats.itemsTranslated << " translated, " << stats.itemsResolved << " resolved" << endl
+              << "  requests         " << stats.requests << " (" << stats.failedBatches << " failed batches; server: "
+              << server->malformedCount() - malformedBefore << " malformed, "
+              << server->truncatedCount() - truncatedBefore << " truncated of "
+              << server->requestCount() - requestsBefore << ")" << endl
+              << "  batch wall       p50 " << QString::number(metrics.wallSeconds().percentile(50), 'f', 2)
+              << " s, p90 " << QString::number(metrics.wallSeconds().percentile(90), 'f', 2) << " s; first byte p50 "
+              << QString::number(metrics.ttfbSeconds().percentile(50), 'f', 2) << " s" << endl
+              << "  server tokens/s  " << QString::number(metrics.tokensPerSecond(), 'f', 1) << endl
+              << "  prompt reused    ~" << metrics.estimatedReusedPromptTokens() << " tokens, ~"
+              << QString::number(metrics.estimatedPromptEvalSecondsSaved(), 'f', 2) << " s prompt eval saved (estimated)" << endl
+              << "  bytes sent       " << kilobytes(stats.bytesSent) << endl
+              << "  bytes received   " << kilobytes(stats.bytesReceived) << endl
+              << "  parse/apply      " << QString::number(stats.parseNs / 1e6, 'f', 1) << " ms" << endl
+              << "  save             " << saveMs << " ms" << endl;
+    }
+
+    QMetaObject::invokeMethod(server, "close", Qt::BlockingQueuedConnection);
+    serverThread.quit();
+    serverThread.wait();
+    return failures == 0 ? 0 : 1;
+}
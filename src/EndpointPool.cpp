@@ -0,0 +1,179 @@
+#include "EndpointPool.h"
+#include <QRegularExpression>
+#include <QStringList>
+#include <QUrl>
+
+namespace {
+// Consecutive failed requests before an endpoint is taken out of rotation
+const int kFailuresToEject = 2;
+// Probe delay after the n-th failed probe: kProbeBaseMs * 2^n, capped
+const int kProbeBaseMs = 2000;
+const int kProbeMaxMs = 60000;
+// Failed probes in a row before the endpoint is dropped
+const int kMaxProbeFailures = 6;
+// Weight of the newest sample in the throughput average
+const double kThroughputAlpha = 0.3;
+}
+
+EndpointPool::EndpointPool()
+{
+    m_clock.start();
+}
+
+bool EndpointPool::parse(const QString &spec, const QString &defaultModel, int defaultSlots, QString *errorString)
+{
+    QVector<Endpoint> endpoints;
+    for (const QString &entry : spec.split(QRegularExpression("[,\\n]"), QString::SkipEmptyParts)) {
+        const QStringList fields = entry.split('|');
+        Endpoint endpoint;
+        endpoint.url = fields.value(0).trimmed();
+        endpoint.model = fields.value(1).trimmed();
+        if (endpoint.model.isEmpty()) endpoint.model = defaultModel;
+        endpoint.slots = defaultSlots;
+        if (!fields.value(2).trimmed().isEmpty()) {
+            bool ok = false;
+            endpoint.slots = fields.value(2).trimmed().toInt(&ok);
+            if (!ok || endpoint.slots < 1) {
+                if (errorString) *errorString = "Invalid slot count in endpoint: " + entry.trimmed();
+                return false;
+            }
+        }
+        if (endpoint.url.isEmpty()) continue;
+        if (!QUrl(endpoint.url).isValid()) {
+            if (errorString) *errorString = "Invalid endpoint URL: " + endpoint.url;
+            return false;
+        }
+        endpoints.append(endpoint);
+    }
+    if (endpoints.isEmpty()) {
+        if (errorString) *errorString = "No API endpoint configured.";
+        return false;
+    }
+    m_endpoints = endpoints;
+    return true;
+}
+
+void EndpointPool::clear()
+{
+    m_endpoints.clear();
+}
+
+int EndpointPool::freeSlots() const
+{
+    int slots = 0;
+    for (const Endpoint &endpoint : m_endpoints) {
+        if (!endpoint.down && !endpoint.dead) slots += qMax(0, endpoint.slots - endpoint.active);
+    }
+    return slots;
+}
+
+bool EndpointPool::hasUsableEndpoint() const
+{
+    for (const Endpoint &endpoint : m_endpoints) {
+        if (!endpoint.dead) return true;
+    }
+    return false;
+}
+
+int EndpointPool::acquire()
+{
+    int best = -1;
+    double bestScore = 0;
+    for (int i = 0; i < m_endpoints.size(); ++i) {
+        const Endpoint &endpoint = m_endpoints.at(i);
+        if (endpoint.down || endpoint.dead || endpoint.active >= endpoint.slots) continue;
+
+        // Expected time until a new batch is done; unmeasured endpoints go first so
+        // that every one of them gets a sample
+        const double score = endpoint.itemsPerSecond > 0
+            ? (endpoint.active + 1) / (endpoint.slots * endpoint.itemsPerSecond)
+            : -1.0 / (endpoint.active + 1);
+        if (best < 0 || score < bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    if (best >= 0) m_endpoints[best].active++;
+    return best;
+}
+
+void EndpointPool::release(int index)
+{
+    Endpoint &endpoint = m_endpoints[index];
+    endpoint.active = qMax(0, endpoint.active - 1);
+}
+
+void EndpointPool::reportSuccess(int index, int items, qint64 wallMs)
+{
+    Endpoint &endpoint = m_endpoints[index];
+    endpoint.failures = 0;
+    if (items <= 0) return;
+
+    const double rate = items * 1000.0 / qMax<qint64>(1, wallMs);
+    endpoint.itemsPerSecond = endpoint.itemsPerSecond > 0
+        ? (1 - kThroughputAlpha) * endpoint.itemsPerSecond + kThroughputAlpha * rate
+        : rate;
+}
+
+bool EndpointPool::reportFailure(int index)
+{
+    Endpoint &endpoint = m_endpoints[index];
+    if (endpoint.down || endpoint.dead) return false;
+    if (++endpoint.failures < kFailuresToEject) return false;
+
+    endpoint.down = true;
+    endpoint.probeFailures = 0;
+    endpoint.probeAtMs = m_clock.elapsed() + kProbeBaseMs;
+    return true;
+}
+
+QVector<int> EndpointPool::probeDue()
+{
+    QVector<int> due;
+    const qint64 now = m_clock.elapsed();
+    for (int i = 0; i < m_endpoints.size(); ++i) {
+        Endpoint &endpoint = m_endpoints[i];
+        if (endpoint.down && !endpoint.dead && !endpoint.probing && endpoint.probeAtMs <= now) {
+            endpoint.probing = true;
+            due.append(i);
+        }
+    }
+    return due;
+}
+
+void EndpointPool::reportProbe(int index, bool ok)
+{
+    Endpoint &endpoint = m_endpoints[index];
+    endpoint.probing = false;
+    if (ok) {
+        endpoint.down = false;
+        endpoint.failures = 0;
+        return;
+    }
+    if (++endpoint.probeFailures >= kMaxProbeFailures) {
+        endpoint.dead = true;
+        return;
+    }
+    endpoint.probeAtMs = m_clock.elapsed() + qMin(kProbeMaxMs, kProbeBaseMs << endpoint.probeFailures);
+}
+
+int EndpointPool::msUntilNextProbe() const
+{
+    qint64 next = -1;
+    for (const Endpoint &endpoint : m_endpoints) {
+        if (endpoint.down && !endpoint.dead && !endpoint.probing && (next < 0 || endpoint.probeAtMs < next)) {
+            next = endpoint.probeAtMs;
+        }
+    }
+    return next < 0 ? -1 : int(qMax<qint64>(0, next - m_clock.elapsed()));
+}
+
+QString EndpointPool::siblingUrl(const QString &apiUrl, const QString &api)
+{
+    QUrl url(apiUrl);
+    QString path = url.path();
+    const int prefix = path.indexOf("/api/");
+    path = (prefix >= 0 ? path.left(prefix) : QString()) + "/api/" + api;
+    url.setPath(path);
+    return url.toString();
+}
@@ -0,0 +1,69 @@
+#ifndef ENDPOINTPOOL_H
+#define ENDPOINTPOOL_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+// Set of Ollama servers a run is spread over.
+//
+// The specification is a comma- (or newline-) separated list of
+//   url[|model[|slots]]
+// e.g. "http://gpu1:11434/api/generate|qwen3:32b|4, http://gpu2:11434/api/generate".
+// Missing models and slot counts take the defaults of the run.
+//
+// acquire() picks the healthy endpoint with a free slot that is expected to finish
+// a new batch first, from its observed throughput and the requests it already has.
+// An endpoint that fails repeatedly is taken out of rotation and has to pass a probe
+// (see probeDue()) before it gets batches again; one that keeps failing its probes
+// is dropped for the rest of the run.
+class EndpointPool {
+public:
+    struct Endpoint {
+        QString url;
+        QString model;
+        int slots = 1;
+        int active = 0;                 // Requests in flight
+        double itemsPerSecond = 0;      // Moving average per request, 0 until measured
+        int failures = 0;               // Consecutive failed requests
+        bool down = false;              // Out of rotation until a probe succeeds
+        bool probing = false;           // Probe request in flight
+        int probeFailures = 0;
+        qint64 probeAtMs = 0;           // When the next probe is due (pool clock)
+        bool dead = false;              // Gave up on this endpoint
+    };
+
+    EndpointPool();
+
+    bool parse(const QString &spec, const QString &defaultModel, int defaultSlots, QString *errorString = nullptr);
+    void clear();
+
+    int size() const { return m_endpoints.size(); }
+    const Endpoint &endpoint(int index) const { return m_endpoints.at(index); }
+    // Free slots of healthy endpoints
+    int freeSlots() const;
+    // False once every endpoint has been dropped
+    bool hasUsableEndpoint() const;
+
+    // Endpoint for the next batch, or -1 when no healthy endpoint has a free slot
+    int acquire();
+    void release(int index);
+    void reportSuccess(int index, int items, qint64 wallMs);
+    // Returns true when the endpoint was taken out of rotation by this failure
+    bool reportFailure(int index);
+
+    // Down endpoints whose probe is due; marks them as probing
+    QVector<int> probeDue();
+    void reportProbe(int index, bool ok);
+    // Milliseconds until the next probe is due, or -1 if none is scheduled
+    int msUntilNextProbe() const;
+
+    // Another API of the same server, e.g. siblingUrl(".../api/generate", "tags") -> ".../api/tags"
+    static QString siblingUrl(const QString &apiUrl, const QString &api);
+
+private:
+    QVector<Endpoint> m_endpoints;
+    QElapsedTimer m_clock;
+};
+
+#endif // ENDPOINTPOOL_H
@@ -0,0 +1,197 @@
+#include "FuzzyIndex.h"
+#include <QRegularExpression>
+#include <QSet>
+#include <algorithm>
+
+namespace {
+const QRegularExpression &numberPattern()
+{
+    static const QRegularExpression pattern("\\d+");
+    return pattern;
+}
+
+// Whitespace and sentence punctuation at the end ("...", ":", "？", ...)
+const QRegularExpression &tailPattern()
+{
+    static const QRegularExpression pattern(QString::fromUtf8("[\\s.:!?\xE2\x80\xA6\xE3\x80\x82\xEF\xBC\x9A\xEF\xBC\x81\xEF\xBC\x9F]*$"));
+    return pattern;
+}
+
+QString tail(const QString &text)
+{
+    return tailPattern().match(text).captured();
+}
+
+QStringList numbers(const QString &text)
+{
+    QStringList list;
+    QRegularExpressionMatchIterator it = numberPattern().globalMatch(text);
+    while (it.hasNext()) {
+        list.append(it.next().captured());
+    }
+    return list;
+}
+
+// Text with numbers, whitespace runs and trailing punctuation normalized
+QString skeleton(const QString &text)
+{
+    QString result = text;
+    result.chop(tail(text).size());
+    result.replace(numberPattern(), "#");
+    return result.simplified();
+}
+}
+
+void FuzzyIndex::clear()
+{
+    m_sources.clear();
+    m_translations.clear();
+    m_signatures.clear();
+    m_buckets.clear();
+    m_skeletons.clear();
+}
+
+void FuzzyIndex::add(const QString &source, const QString &translation)
+{
+    // Variants of an indexed source add nothing but duplicate examples
+    const QString key = skeleton(source);
+    if (source.trimmed().isEmpty() || translation.isEmpty() || m_skeletons.contains(key)) return;
+
+    const int entry = m_sources.size();
+    m_sources.append(source);
+    m_translations.append(translation);
+    m_skeletons.insert(key, entry);
+
+    const QVector<quint32> sig = signature(source);
+    m_signatures.append(sig);
+    for (int band = 0; band < kBands; ++band) {
+        m_buckets[bandKey(sig.constData(), band)].append(entry);
+    }
+}
+
+int FuzzyIndex::size() const
+{
+    return m_sources.size();
+}
+
+bool FuzzyIndex::exactVariant(const QString &source, QString *translation) const
+{
+    const int entry = m_skeletons.value(skeleton(source), -1);
+    if (entry < 0) return false;
+
+    const QString &known = m_sources.at(entry);
+    QString result = m_translations.at(entry);
+    if (known == source) {
+        *translation = result;
+        return true;
+    }
+
+    // The known translation must carry the numbers of its source in the same order;
+    // they are replaced one by one
+    const QStringList knownNumbers = numbers(known);
+    const QStringList newNumbers = numbers(source);
+    if (knownNumbers != newNumbers) {
+        QString adapted;
+        int last = 0;
+        int n = 0;
+        QRegularExpressionMatchIterator it = numberPattern().globalMatch(result);
+        while (it.hasNext()) {
+            const QRegularExpressionMatch match = it.next();
+            if (n >= knownNumbers.size() || match.captured() != knownNumbers.at(n)) return false;
+            adapted += result.midRef(last, match.capturedStart() - last);
+            adapted += newNumbers.at(n++);
+            last = match.capturedEnd();
+        }
+        if (n != knownNumbers.size()) return false;
+        adapted += result.midRef(last);
+        result = adapted;
+    }
+
+    // Trailing punctuation is swapped only if the translation ends exactly like its source
+    const QString knownTail = tail(known);
+    const QString newTail = tail(source);
+    if (knownTail != newTail) {
+        if (tail(result) != knownTail) return false;
+        result.chop(knownTail.size());
+        result += newTail;
+    }
+    *translation = result;
+    return true;
+}
+
+QVector<FuzzyIndex::Match> FuzzyIndex::similar(const QString &source, int maxResults, double minSimilarity) const
+{
+    QVector<Match> matches;
+    if (m_sources.isEmpty() || maxResults <= 0) return matches;
+
+    const QVector<quint32> sig = signature(source);
+    QSet<int> candidates;
+    for (int band = 0; band < kBands; ++band) {
+        auto it = m_buckets.constFind(bandKey(sig.constData(), band));
+        if (it == m_buckets.constEnd()) continue;
+        for (int entry : it.value()) {
+            candidates.insert(entry);
+        }
+    }
+
+    const quint32 *mine = sig.constData();
+    for (int entry : candidates) {
+        const quint32 *other = m_signatures.constData() + entry * kSignatureSize;
+        int equal = 0;
+        for (int k = 0; k < kSignatureSize; ++k) {
+            equal += mine[k] == other[k];
+        }
+        const double similarity = double(equal) / kSignatureSize;
+        if (similarity >= minSimilarity && m_sources.at(entry) != source) {
+            Match match;
+            match.source = m_sources.at(entry);
+            match.translation = m_translations.at(entry);
+            match.similarity = similarity;
+            matches.append(match);
+        }
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const Match &a, const Match &b) {
+        return a.similarity > b.similarity;
+    });
+    if (matches.size() > maxResults) {
+        matches.resize(maxResults);
+    }
+    return matches;
+}
+
+QVector<quint32> FuzzyIndex::signature(const QString &text)
+{
+    const QString normalized = text.toLower().simplified();
+    const int length = normalized.size();
+    QVector<quint32> sig(kSignatureSize, 0xFFFFFFFFu);
+    quint32 *slots = sig.data();
+
+    // Texts shorter than three characters form a single shingle
+    const int shingles = qMax(1, length - 2);
+    for (int i = 0; i < shingles; ++i) {
+        quint32 h = 2166136261u;   // FNV-1a over the 3-gram
+        for (int j = i; j < qMin(length, i + 3); ++j) {
+            h = (h ^ normalized.at(j).unicode()) * 16777619u;
+        }
+        // One independent hash per slot (murmur3 finalizer over a per-slot seed)
+        for (int k = 0; k < kSignatureSize; ++k) {
+            quint32 x = (h ^ (0x9E3779B9u * quint32(k + 1))) * 0x85EBCA6Bu;
+            x ^= x >> 13;
+            x *= 0xC2B2AE35u;
+            x ^= x >> 16;
+            slots[k] = qMin(slots[k], x);
+        }
+    }
+    return sig;
+}
+
+quint64 FuzzyIndex::bandKey(const quint32 *signature, int band)
+{
+    const int rows = kSignatureSize / kBands;
+    quint64 key = quint64(band) + 1;
+    for (int r = 0; r < rows; ++r) {
+        key = (key ^ signature[band * rows + r]) * 1099511628211ULL;
+    }
+    return key;
+}
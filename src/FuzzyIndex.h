@@ -0,0 +1,50 @@
+#ifndef FUZZYINDEX_H
+#define FUZZYINDEX_H
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+// Similarity index over the finished (source, translation) pairs of a document.
+//
+// Each source is reduced to a MinHash signature of its lower-cased character
+// 3-grams. Locality-sensitive hashing over bands of the signature yields candidate
+// entries, which are ranked by the share of equal signature slots (an estimate of
+// the Jaccard similarity of the 3-gram sets). Signatures live in one flat array so
+// the slot comparison is a tight loop the compiler can vectorize.
+//
+// exactVariant() additionally derives a translation for a source that differs from
+// a known one only in its numbers, whitespace or trailing punctuation.
+class FuzzyIndex {
+public:
+    struct Match {
+        QString source;
+        QString translation;
+        double similarity = 0;   // 0..1
+    };
+
+    void clear();
+    void add(const QString &source, const QString &translation);
+    int size() const;
+
+    // Translation of a known source with the same text up to numbers / punctuation,
+    // adapted to the new numbers and trailing punctuation
+    bool exactVariant(const QString &source, QString *translation) const;
+    // Most similar entries first
+    QVector<Match> similar(const QString &source, int maxResults, double minSimilarity) const;
+
+private:
+    static const int kSignatureSize = 32;
+    static const int kBands = 16;          // kSignatureSize / kBands slots per band
+
+    static QVector<quint32> signature(const QString &text);
+    static quint64 bandKey(const quint32 *signature, int band);
+
+    QStringList m_sources;
+    QStringList m_translations;
+    QVector<quint32> m_signatures;          // kSignatureSize slots per entry
+    QHash<quint64, QVector<int>> m_buckets; // Band key -> entries
+    QHash<QString, int> m_skeletons;        // Source with numbers and punctuation normalized -> entry
+};
+
+#endif // FUZZYINDEX_H
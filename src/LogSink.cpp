@@ -0,0 +1,88 @@
+#include "LogSink.h"
+
+namespace {
+// Pending messages kept between two flushes
+const int kRingSize = 2000;
+// Lines kept in the view
+const int kMaxBlocks = 5000;
+// Longer messages are cut off
+const int kMaxMessageChars = 2000;
+const int kFlushIntervalMs = 100;
+}
+
+LogSink::LogSink(QPlainTextEdit *view, QObject *parent)
+    : QObject(parent)
+    , m_view(view)
+    , m_level(TranslatorEngine::LogInfo)
+    , m_ring(kRingSize)
+    , m_head(0)
+    , m_count(0)
+    , m_dropped(0)
+{
+    m_view->setMaximumBlockCount(kMaxBlocks);
+    m_timer.setInterval(kFlushIntervalMs);
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &LogSink::flush);
+}
+
+void LogSink::setLevel(TranslatorEngine::LogLevel level)
+{
+    m_level = level;
+}
+
+TranslatorEngine::LogLevel LogSink::level() const
+{
+    return m_level;
+}
+
+void LogSink::clear()
+{
+    m_timer.stop();
+    m_head = 0;
+    m_count = 0;
+    m_dropped = 0;
+    m_view->clear();
+}
+
+void LogSink::append(const QString &msg, TranslatorEngine::LogLevel level)
+{
+    if (level > m_level) return;
+
+    QString line = msg.size() > kMaxMessageChars ? msg.left(kMaxMessageChars) + "..." : msg;
+    if (m_count == kRingSize) {
+        // Full: overwrite the oldest message
+        m_ring[m_head] = line;
+        m_head = (m_head + 1) % kRingSize;
+        m_dropped++;
+    } else {
+        m_ring[(m_head + m_count) % kRingSize] = line;
+        m_count++;
+    }
+
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+}
+
+void LogSink::flush()
+{
+    m_timer.stop();
+    if (m_count == 0) return;
+
+    QString chunk;
+    if (m_dropped > 0) {
+        chunk = QString("... %1 log messages dropped ...\n").arg(m_dropped);
+    }
+    for (int i = 0; i < m_count; ++i) {
+        QString &line = m_ring[(m_head + i) % kRingSize];
+        chunk += line;
+        if (i + 1 < m_count) chunk += '\n';
+        line.clear();
+    }
+    m_head = 0;
+    m_count = 0;
+    m_dropped = 0;
+
+    // One document update for the whole chunk
+    m_view->appendPlainText(chunk);
+}
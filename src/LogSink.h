@@ -0,0 +1,43 @@
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+#include <QObject>
+#include <QPlainTextEdit>
+#include <QTimer>
+#include <QVector>
+#include "TranslatorEngine.h"
+
+// Buffers log messages for a QPlainTextEdit and writes them in coalesced chunks
+// on a timer, so a burst of engine messages costs one document update instead of
+// one per line. Pending messages are kept in a bounded ring buffer (the oldest
+// are dropped and counted), long messages are shortened, and the view keeps at
+// most kMaxBlocks lines.
+class LogSink : public QObject {
+    Q_OBJECT
+
+public:
+    explicit LogSink(QPlainTextEdit *view, QObject *parent = nullptr);
+
+    // Messages above this level are discarded
+    void setLevel(TranslatorEngine::LogLevel level);
+    TranslatorEngine::LogLevel level() const;
+
+    // Clears the view and everything still pending
+    void clear();
+
+public slots:
+    void append(const QString &msg, TranslatorEngine::LogLevel level = TranslatorEngine::LogInfo);
+    // Writes pending messages now (e.g. before a modal dialog)
+    void flush();
+
+private:
+    QPlainTextEdit *m_view;
+    QTimer m_timer;
+    TranslatorEngine::LogLevel m_level;
+    QVector<QString> m_ring;   // Pending messages, m_head is the oldest
+    int m_head;
+    int m_count;
+    int m_dropped;             // Messages lost to the ring since the last flush
+};
+
+#endif // LOGSINK_H
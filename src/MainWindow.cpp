@@ -1,8 +1,11 @@
 #include "MainWindow.h"
+#include "LogSink.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QDir>
 #include <QMessageBox>
 #include <QApplication>
 #include <QMenu>
@@ -12,18 +15,29 @@
 #endif
 
 MainWindow::MainWindow(QWidget *parent)
-    : QWidget(parent), m_engine(new TranslatorEngine(this))
+    : QWidget(parent), m_engine(new TranslatorEngine())
 {
     setupUi();
     
+    // Loading, batching, response parsing and saving run on the engine thread so the
+    // window stays responsive; the signals below are delivered as queued connections
+    // and every call into the engine goes through QMetaObject::invokeMethod()
+    m_engine->moveToThread(&m_engineThread);
+    connect(&m_engineThread, &QThread::finished, m_engine, &QObject::deleteLater);
     connect(m_engine, &TranslatorEngine::logMessage, this, &MainWindow::onLog);
     connect(m_engine, &TranslatorEngine::progressUpdated, this, &MainWindow::onProgress);
     connect(m_engine, &TranslatorEngine::translationFinished, this, &MainWindow::onFinished);
     connect(m_engine, &TranslatorEngine::errorOccurred, this, &MainWindow::onError);
+    m_engineThread.start();
 }
 
 MainWindow::~MainWindow()
 {
+    // Cancel requests in flight before the engine is deleted on its own thread
+    TranslatorEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine]() { engine->stopTranslation(); }, Qt::BlockingQueuedConnection);
+    m_engineThread.quit();
+    m_engineThread.wait();
 }
 
 void MainWindow::setupUi()
@@ -62,7 +76,7 @@ void MainWindow::setupUi()
         }
 
         /* Inputs */
-        QLineEdit, QComboBox {
+        QLineEdit, QComboBox, QSpinBox {
             border: 1px solid #D1D5DB; /* Gray 300 */
             border-radius: 8px;
             padding: 8px 12px;
@@ -70,7 +84,7 @@ void MainWindow::setupUi()
             selection-background-color: #6366F1;
             min-height: 20px;
         }
-        QLineEdit:focus, QComboBox:focus {
+        QLineEdit:focus, QComboBox:focus, QSpinBox:focus {
             border: 2px solid #6366F1; /* Indigo 500 */
             background-color: #FFFFFF;
             padding: 7px 11px; /* Adjust for 2px border */
@@ -138,7 +152,7 @@ void MainWindow::setupUi()
         }
 
         /* Log Console (Dark Mode) */
-        QTextEdit {
+        QPlainTextEdit {
             background-color: #1F2937; /* Gray 800 */
             color: #E5E7EB; /* Gray 200 */
             border: 1px solid #374151;
@@ -184,6 +198,7 @@ void MainWindow::setupUi()
     m_langCombo->setEditable(true);
     
     m_apiEdit = new QLineEdit("http://localhost:11434/api/generate");
+    m_apiEdit->setToolTip(QString::fromUtf8("\xE5\xA4\x9A\xE5\x8F\xB0\xE6\x9C\x8D\xE5\x8A\xA1\xE5\x99\xA8\xE7\x94\xA8\xE9\x80\x97\xE5\x8F\xB7\xE5\x88\x86\xE9\x9A\x94\xEF\xBC\x8C\xE6\xAF\x8F\xE9\xA1\xB9\xE5\x8F\xAF\xE5\x86\x99\xE4\xB8\xBA url|model|slots")); // Several servers: comma-separated, each url|model|slots
     m_modelEdit = new QLineEdit("qwen3:14b");
     
     // Add Labels with better styling if needed, but default is fine
@@ -194,10 +209,63 @@ void MainWindow::setupUi()
     settingsLayout->addWidget(new QLabel(QString::fromUtf8("\xE6\xA8\xA1\xE5\x9E\x8B\xE5\x90\x8D\xE7\xA7\xB0:")), 2, 0); // Model Name
     settingsLayout->addWidget(m_modelEdit, 2, 1);
     
+    // Escalation model: suspect results of the model above are translated again by it
+    m_escalationEdit = new QLineEdit();
+    m_escalationEdit->setPlaceholderText(QString::fromUtf8("\xE5\x8F\xAF\xE9\x80\x89\xEF\xBC\x8C\xE5\xA6\x82 qwen3:32b")); // Optional, e.g. qwen3:32b
+    settingsLayout->addWidget(new QLabel(QString::fromUtf8("\xE5\x8D\x87\xE7\xBA\xA7\xE6\xA8\xA1\xE5\x9E\x8B:")), 3, 0); // Escalation Model
+    settingsLayout->addWidget(m_escalationEdit, 3, 1);
+    
+    // Concurrent requests (should match OLLAMA_NUM_PARALLEL on the server)
+    m_concurrencySpin = new QSpinBox();
+    m_concurrencySpin->setRange(1, 16);
+    m_concurrencySpin->setValue(m_engine->maxConcurrency());
+    settingsLayout->addWidget(new QLabel(QString::fromUtf8("\xE5\xB9\xB6\xE5\x8F\x91\xE8\xAF\xB7\xE6\xB1\x82\xE6\x95\xB0:")), 4, 0); // Concurrent Requests
+    settingsLayout->addWidget(m_concurrencySpin, 4, 1);
+    
+    // Context window of the model; batches are sized to fit into it
+    m_contextSpin = new QSpinBox();
+    m_contextSpin->setRange(1024, 131072);
+    m_contextSpin->setSingleStep(1024);
+    m_contextSpin->setValue(m_engine->contextSize());
+    m_contextSpin->setSuffix(" tokens");
+    settingsLayout->addWidget(new QLabel(QString::fromUtf8("\xE4\xB8\x8A\xE4\xB8\x8B\xE6\x96\x87\xE9\x95\xBF\xE5\xBA\xA6:")), 5, 0); // Context Size
+    settingsLayout->addWidget(m_contextSpin, 5, 1);
+    
     // Add Retranslate All Checkbox
     m_retranslateCheck = new QCheckBox(QString::fromUtf8("\xE9\x87\x8D\xE6\x96\xB0\xE7\xBF\xBB\xE8\xAF\x91\xE6\x89\x80\xE6\x9C\x89\xE6\x9D\xA1\xE7\x9B\xAE (Retranslate All)"));
     // Add some styling or spacing if needed
-    settingsLayout->addWidget(m_retranslateCheck, 3, 1);
+    settingsLayout->addWidget(m_retranslateCheck, 6, 1);
+    
+    // Translation memory: reuse translations from earlier runs without calling the model
+    m_memoryCheck = new QCheckBox(QString::fromUtf8("\xE4\xBD\xBF\xE7\x94\xA8\xE7\xBF\xBB\xE8\xAF\x91\xE8\xAE\xB0\xE5\xBF\x86\xE5\xBA\x93 (Translation Memory)"));
+    m_memoryCheck->setChecked(m_engine->isTranslationMemoryEnabled());
+    settingsLayout->addWidget(m_memoryCheck, 7, 1);
+    
+    // Streaming: apply translations while the model is still generating the batch
+    m_streamCheck = new QCheckBox(QString::fromUtf8("\xE6\xB5\x81\xE5\xBC\x8F\xE8\xBE\x93\xE5\x87\xBA (Streaming)"));
+    m_streamCheck->setChecked(m_engine->isStreamingEnabled());
+    settingsLayout->addWidget(m_streamCheck, 8, 1);
+    
+    // Prefix reuse: fixed system prompt on /api/chat so the server's prompt cache is hit
+    m_prefixCheck = new QCheckBox(QString::fromUtf8("\xE5\xA4\x8D\xE7\x94\xA8\xE6\x8F\x90\xE7\xA4\xBA\xE5\x89\x8D\xE7\xBC\x80 (Prompt Cache, /api/chat)"));
+    m_prefixCheck->setChecked(m_engine->isPrefixCacheEnabled());
+    settingsLayout->addWidget(m_prefixCheck, 9, 1);
+    
+    // Autosave: keep {name}_{lang}.autosave.ts next to the input up to date during the run
+    m_autosaveCheck = new QCheckBox(QString::fromUtf8("\xE8\x87\xAA\xE5\x8A\xA8\xE4\xBF\x9D\xE5\xAD\x98 (Autosave)"));
+    m_autosaveCheck->setChecked(true);
+    m_autosaveCheck->setToolTip("{name}_{lang}.autosave.ts");
+    settingsLayout->addWidget(m_autosaveCheck, 10, 1);
+    
+    // Log level: debug shows per-batch details and raw model output
+    m_logLevelCombo = new QComboBox();
+    m_logLevelCombo->addItem(QString::fromUtf8("\xE9\x94\x99\xE8\xAF\xAF"), TranslatorEngine::LogError);   // Error
+    m_logLevelCombo->addItem(QString::fromUtf8("\xE8\xAD\xA6\xE5\x91\x8A"), TranslatorEngine::LogWarning); // Warning
+    m_logLevelCombo->addItem(QString::fromUtf8("\xE4\xBF\xA1\xE6\x81\xAF"), TranslatorEngine::LogInfo);    // Info
+    m_logLevelCombo->addItem(QString::fromUtf8("\xE8\xB0\x83\xE8\xAF\x95"), TranslatorEngine::LogDebug);   // Debug
+    m_logLevelCombo->setCurrentIndex(m_logLevelCombo->findData(m_engine->logLevel()));
+    settingsLayout->addWidget(new QLabel(QString::fromUtf8("\xE6\x97\xA5\xE5\xBF\x97\xE7\xBA\xA7\xE5\x88\xAB:")), 11, 0); // Log Level
+    settingsLayout->addWidget(m_logLevelCombo, 11, 1);
     
     mainLayout->addWidget(settingsGroup);
     
@@ -211,6 +279,12 @@ void MainWindow::setupUi()
     m_startBtn->setMinimumWidth(160);
     m_startBtn->setMinimumHeight(45); // Taller button
     
+    m_stopBtn = new QPushButton(QString::fromUtf8("\xE5\x81\x9C\xE6\xAD\xA2")); // "Stop"
+    m_stopBtn->setCursor(Qt::PointingHandCursor);
+    m_stopBtn->setEnabled(false);
+    m_stopBtn->setMinimumWidth(120);
+    m_stopBtn->setMinimumHeight(45);
+    
     m_saveBtn = new QPushButton(QString::fromUtf8("\xE4\xBF\x9D\xE5\xAD\x98\xE6\x96\x87\xE4\xBB\xB6")); // "Save File"
     m_saveBtn->setCursor(Qt::PointingHandCursor);
     m_saveBtn->setEnabled(false);
@@ -226,6 +300,7 @@ void MainWindow::setupUi()
     )");
 
     btnLayout->addWidget(m_startBtn);
+    btnLayout->addWidget(m_stopBtn);
     btnLayout->addWidget(m_saveBtn);
     btnLayout->addStretch();
     
@@ -238,22 +313,24 @@ void MainWindow::setupUi()
     mainLayout->addWidget(m_progressBar);
     
     // --- Log ---
-    m_logEdit = new QTextEdit();
+    m_logEdit = new QPlainTextEdit();
     m_logEdit->setReadOnly(true);
+    m_logSink = new LogSink(m_logEdit, this);
+    m_logSink->setLevel(m_engine->logLevel());
     m_logEdit->setPlaceholderText(QString::fromUtf8("\xE6\x97\xA5\xE5\xBF\x97\xE5\xB0\x86\xE6\x98\xBE\xE7\xA4\xBA\xE5\x9C\xA8\xE8\xBF\x99\xE9\x87\x8C...")); // "Logs will appear here..."
     m_logEdit->setContextMenuPolicy(Qt::CustomContextMenu);
-    connect(m_logEdit, &QTextEdit::customContextMenuRequested, this, [this](const QPoint &pos) {
+    connect(m_logEdit, &QPlainTextEdit::customContextMenuRequested, this, [this](const QPoint &pos) {
         QMenu *menu = new QMenu(this);
         
         QAction *copyAct = menu->addAction("Copy");
         copyAct->setEnabled(m_logEdit->textCursor().hasSelection());
-        connect(copyAct, &QAction::triggered, m_logEdit, &QTextEdit::copy);
+        connect(copyAct, &QAction::triggered, m_logEdit, &QPlainTextEdit::copy);
         
-        menu->addAction("Select All", m_logEdit, &QTextEdit::selectAll);
+        menu->addAction("Select All", m_logEdit, &QPlainTextEdit::selectAll);
         
         menu->addSeparator();
         
-        menu->addAction(QString::fromUtf8("\xE6\xB8\x85\xE7\xA9\xBA\xE6\x97\xA5\xE5\xBF\x97"), m_logEdit, &QTextEdit::clear); // "Clear Log"
+        menu->addAction(QString::fromUtf8("\xE6\xB8\x85\xE7\xA9\xBA\xE6\x97\xA5\xE5\xBF\x97"), m_logSink, &LogSink::clear); // "Clear Log"
         
         menu->exec(m_logEdit->mapToGlobal(pos));
         delete menu;
@@ -262,7 +339,13 @@ void MainWindow::setupUi()
     
     connect(m_browseBtn, &QPushButton::clicked, this, &MainWindow::onBrowse);
     connect(m_startBtn, &QPushButton::clicked, this, &MainWindow::onStart);
+    connect(m_stopBtn, &QPushButton::clicked, this, &MainWindow::onStop);
     connect(m_saveBtn, &QPushButton::clicked, this, &MainWindow::onSave);
+    connect(m_logLevelCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+        TranslatorEngine::LogLevel level = TranslatorEngine::LogLevel(m_logLevelCombo->currentData().toInt());
+        m_logSink->setLevel(level);
+        QMetaObject::invokeMethod(m_engine, [engine = m_engine, level]() { engine->setLogLevel(level); });
+    });
     
     resize(750, 650);
     setWindowTitle("LLM Translator (Ollama)");
@@ -278,6 +361,16 @@ void MainWindow::onBrowse()
     QString path = QFileDialog::getOpenFileName(this, "Open TS File", "", "Qt Translation Files (*.ts);;All Files (*)");
     if (!path.isEmpty()) {
         m_pathEdit->setText(path);
+        
+        // Load the model while the user is still going through the settings
+        TranslatorEngine *engine = m_engine;
+        const QString apiUrl = m_apiEdit->text();
+        const QString modelName = m_modelEdit->text();
+        const QString escalationModel = m_escalationEdit->text();
+        QMetaObject::invokeMethod(engine, [=]() {
+            engine->setEscalationModel(escalationModel);
+            engine->warmUp(apiUrl, modelName);
+        });
     }
 }
 
@@ -290,22 +383,48 @@ void MainWindow::onStart()
     }
     
     m_startBtn->setEnabled(false);
+    m_stopBtn->setEnabled(true);
     m_saveBtn->setEnabled(false);
-    m_logEdit->clear();
+    m_logSink->clear();
+    m_progressBar->setValue(0);
     
-    if (m_engine->loadFile(path)) {
-        m_progressBar->setMaximum(m_engine->getUnfinishedCount());
-        m_progressBar->setValue(0);
-        
-        QString targetLang = m_langCombo->currentText();
-        QString apiUrl = m_apiEdit->text();
-        QString modelName = m_modelEdit->text();
-        bool retranslateAll = m_retranslateCheck->isChecked();
-        
-        m_engine->startTranslation(targetLang, apiUrl, modelName, retranslateAll);
-    } else {
-        m_startBtn->setEnabled(true);
+    // Several languages can be entered separated by commas, e.g. "Japanese, German"
+    QStringList targetLangs;
+    for (const QString &lang : m_langCombo->currentText().split(',', QString::SkipEmptyParts)) {
+        if (!lang.trimmed().isEmpty()) targetLangs.append(lang.trimmed());
     }
+    QString apiUrl = m_apiEdit->text();
+    QString modelName = m_modelEdit->text();
+    QString escalationModel = m_escalationEdit->text();
+    bool retranslateAll = m_retranslateCheck->isChecked();
+    int concurrency = m_concurrencySpin->value();
+    int contextSize = m_contextSpin->value();
+    bool useMemory = m_memoryCheck->isChecked();
+    bool streaming = m_streamCheck->isChecked();
+    bool prefixCache = m_prefixCheck->isChecked();
+    QString autosavePattern = m_autosaveCheck->isChecked() ? QString("{dir}/{name}_{lang}.autosave.ts") : QString();
+    
+    // Parsing a large file takes a while, so it happens on the engine thread as well;
+    // a load error arrives through errorOccurred() and re-enables the Start button
+    TranslatorEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [=]() {
+        if (!engine->loadFile(path)) return;
+        engine->setMaxConcurrency(concurrency);
+        engine->setContextSize(contextSize);
+        engine->setTranslationMemoryEnabled(useMemory);
+        engine->setStreamingEnabled(streaming);
+        engine->setPrefixCacheEnabled(prefixCache);
+        engine->setAutosave(autosavePattern);
+        engine->setEscalationModel(escalationModel);
+        engine->startTranslation(targetLangs, apiUrl, modelName, retranslateAll);
+    });
+}
+
+void MainWindow::onStop()
+{
+    m_stopBtn->setEnabled(false);
+    TranslatorEngine *engine = m_engine;
+    QMetaObject::invokeMethod(engine, [engine]() { engine->stopTranslation(); });
 }
 
 void MainWindow::onSave()
@@ -313,17 +432,35 @@ void MainWindow::onSave()
     QString path = m_pathEdit->text();
     if (path.isEmpty()) return;
     
+    // Several target languages: one file per language in the chosen directory
+    TranslatorEngine *engine = m_engine;
+    QStringList langs;
+    QMetaObject::invokeMethod(engine, [engine]() { return engine->targetLanguages(); }, Qt::BlockingQueuedConnection, &langs);
+    if (langs.size() > 1) {
+        QString dir = QFileDialog::getExistingDirectory(this, "Save Translated Files", QFileInfo(path).absolutePath());
+        if (dir.isEmpty()) return;
+        QString baseName = QDir(dir).filePath(QFileInfo(path).completeBaseName());
+        QMetaObject::invokeMethod(engine, [engine, langs, baseName]() {
+            for (const QString &lang : langs) {
+                QString langTag = lang;
+                langTag.replace(' ', '_');
+                engine->saveFile(baseName + "_" + langTag + ".ts", lang);
+            }
+        });
+        return;
+    }
+    
     // Maybe prompt for new path? For now overwrite or save as new
     // Let's ask user where to save
     QString savePath = QFileDialog::getSaveFileName(this, "Save Translated File", path, "Qt Translation Files (*.ts)");
     if (!savePath.isEmpty()) {
-        m_engine->saveFile(savePath);
+        QMetaObject::invokeMethod(engine, [engine, savePath]() { engine->saveFile(savePath); });
     }
 }
 
-void MainWindow::onLog(const QString &msg)
+void MainWindow::onLog(const QString &msg, TranslatorEngine::LogLevel level)
 {
-    m_logEdit->append(msg);
+    m_logSink->append(msg, level);
 }
 
 void MainWindow::onProgress(int current, int total)
@@ -334,14 +471,17 @@ void MainWindow::onProgress(int current, int total)
 
 void MainWindow::onFinished()
 {
+    m_logSink->flush();
     m_startBtn->setEnabled(true);
+    m_stopBtn->setEnabled(false);
     m_saveBtn->setEnabled(true);
     QMessageBox::information(this, "Done", "Translation process finished.");
 }
 
 void MainWindow::onError(const QString &err)
 {
-    m_logEdit->append("ERROR: " + err);
+    m_logSink->append("ERROR: " + err, TranslatorEngine::LogError);
+    m_logSink->flush();
     QMessageBox::critical(this, "Error", err);
     m_startBtn->setEnabled(true);
 }
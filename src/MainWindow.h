@@ -4,13 +4,17 @@
 #include <QWidget>
 #include <QLineEdit>
 #include <QComboBox>
-#include <QTextEdit>
+#include <QPlainTextEdit>
 #include <QProgressBar>
 #include <QPushButton>
 #include <QCheckBox>
+#include <QSpinBox>
 #include <QGroupBox>
+#include <QThread>
 #include "TranslatorEngine.h"
 
+class LogSink;
+
 class MainWindow : public QWidget {
     Q_OBJECT
 
@@ -21,8 +25,9 @@ public:
 private slots:
     void onBrowse();
     void onStart();
+    void onStop();
     void onSave();
-    void onLog(const QString &msg);
+    void onLog(const QString &msg, TranslatorEngine::LogLevel level);
     void onProgress(int current, int total);
     void onFinished();
     void onError(const QString &err);
@@ -36,15 +41,26 @@ private:
     QComboBox *m_langCombo;
     QLineEdit *m_apiEdit;
     QLineEdit *m_modelEdit;
+    QLineEdit *m_escalationEdit;
+    QSpinBox *m_concurrencySpin;   // Number of batch requests in flight
+    QSpinBox *m_contextSpin;       // Model context window (tokens) used to size batches
     QCheckBox *m_retranslateCheck; // Checkbox for retranslating all items
+    QCheckBox *m_memoryCheck;      // Checkbox for using the translation memory
+    QCheckBox *m_streamCheck;      // Checkbox for streaming responses
+    QCheckBox *m_prefixCheck;      // Checkbox for prompt prefix reuse (/api/chat)
+    QCheckBox *m_autosaveCheck;    // Checkbox for periodic background autosave
+    QComboBox *m_logLevelCombo;    // Most detailed log level shown
     
-    QTextEdit *m_logEdit;
+    QPlainTextEdit *m_logEdit;
+    LogSink *m_logSink;            // Batches log lines into m_logEdit
     QProgressBar *m_progressBar;
     
     QPushButton *m_startBtn;
+    QPushButton *m_stopBtn;
     QPushButton *m_saveBtn;
     
-    TranslatorEngine *m_engine;
+    TranslatorEngine *m_engine;    // Lives on m_engineThread
+    QThread m_engineThread;
 };
 
 #endif // MAINWINDOW_H
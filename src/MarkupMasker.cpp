@@ -0,0 +1,120 @@
+#include "MarkupMasker.h"
+#include <QRegularExpression>
+#include <QVector>
+
+namespace {
+const QRegularExpression &sentinelPattern()
+{
+    static const QRegularExpression pattern("\\{(\\d+)\\}");
+    return pattern;
+}
+
+// One maskable span: a whole <head>/<style> block or comment, a single tag, an entity
+// or a Qt argument
+const QRegularExpression &spanPattern()
+{
+    static const QRegularExpression pattern(
+        "<head\\b[^>]*>.*?</head>|<style\\b[^>]*>.*?</style>|<!--.*?-->"
+        "|</?[!?]?[A-Za-z][^<>]*>"
+        "|&(?:[A-Za-z][A-Za-z0-9]*|#[0-9]+|#[xX][0-9A-Fa-f]+);"
+        "|%L?(?:[1-9][0-9]?|n)",
+        QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+    return pattern;
+}
+
+// A single '&' in front of a visible character ("&&" is a literal ampersand)
+const QRegularExpression &mnemonicPattern()
+{
+    static const QRegularExpression pattern("(?<!&)&(?![&\\s])");
+    return pattern;
+}
+
+// "(&F)" goes before a trailing ellipsis or colon, as in "打开(&O)..."
+const QRegularExpression &suffixPattern()
+{
+    static const QRegularExpression pattern(QString::fromUtf8("(\\.\\.\\.|\xE2\x80\xA6|:|\xEF\xBC\x9A)\\s*$"));
+    return pattern;
+}
+}
+
+MarkupMasker::Masked MarkupMasker::mask(const QString &source)
+{
+    Masked masked;
+    if (source.contains(sentinelPattern())) {
+        masked.text = source;
+        return masked;
+    }
+
+    int last = 0;
+    QRegularExpressionMatchIterator it = spanPattern().globalMatch(source);
+    while (it.hasNext()) {
+        const QRegularExpressionMatch match = it.next();
+        const QString gap = source.mid(last, match.capturedStart() - last);
+        const QString span = match.captured();
+        if (!masked.spans.isEmpty() && gap.trimmed().isEmpty() && span.startsWith('<')
+            && masked.spans.last().startsWith('<')) {
+            // A run of tags with only whitespace in between becomes one sentinel
+            masked.spans.last() += gap + span;
+        } else {
+            masked.text += gap;
+            masked.text += QString("{%1}").arg(masked.spans.size());
+            masked.spans.append(span);
+        }
+        last = match.capturedEnd();
+    }
+    masked.text += source.midRef(last);
+
+    QRegularExpressionMatchIterator mnemonics = mnemonicPattern().globalMatch(masked.text);
+    if (mnemonics.hasNext()) {
+        const int pos = mnemonics.next().capturedStart();
+        if (!mnemonics.hasNext()) {
+            masked.mnemonic = masked.text.at(pos + 1);
+            masked.text.remove(pos, 1);
+        }
+    }
+    return masked;
+}
+
+bool MarkupMasker::unmask(const QString &translation, const Masked &masked, QString *result)
+{
+    QString out;
+    bool placed = masked.mnemonic.isNull() || translation.contains(mnemonicPattern());
+    auto appendText = [&](const QStringRef &segment) {
+        const int pos = placed ? -1 : segment.indexOf(masked.mnemonic, 0, Qt::CaseInsensitive);
+        if (pos >= 0) {
+            out += segment.left(pos);
+            out += '&';
+            out += segment.mid(pos);
+            placed = true;
+        } else {
+            out += segment;
+        }
+    };
+
+    if (masked.spans.isEmpty()) {
+        appendText(QStringRef(&translation));
+    } else {
+        QVector<int> seen(masked.spans.size(), 0);
+        int last = 0;
+        QRegularExpressionMatchIterator it = sentinelPattern().globalMatch(translation);
+        while (it.hasNext()) {
+            const QRegularExpressionMatch match = it.next();
+            const int index = match.captured(1).toInt();
+            if (index >= masked.spans.size()) return false;
+            seen[index]++;
+            appendText(translation.midRef(last, match.capturedStart() - last));
+            out += masked.spans.at(index);
+            last = match.capturedEnd();
+        }
+        appendText(translation.midRef(last));
+        if (seen.count(1) != seen.size()) return false;
+    }
+
+    if (!placed) {
+        const QRegularExpressionMatch suffix = suffixPattern().match(out);
+        out.insert(suffix.hasMatch() ? suffix.capturedStart() : out.size(),
+                   QString("(&%1)").arg(masked.mnemonic.toUpper()));
+    }
+    *result = out;
+    return true;
+}
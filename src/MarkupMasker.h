@@ -0,0 +1,30 @@
+#ifndef MARKUPMASKER_H
+#define MARKUPMASKER_H
+
+#include <QChar>
+#include <QString>
+#include <QStringList>
+
+// Hides the parts of a source string the model must copy verbatim.
+//
+// Qt arguments (%1, %L2, %n), runs of HTML / rich-text tags and character entities
+// are replaced by compact sentinels {0}, {1}, ... before the text is sent, which
+// saves tokens on Designer rich text and keeps the model from rewriting them. A
+// keyboard mnemonic ("&File") is stripped and placed again after translation, on
+// the same letter if the translation contains it, else as a "(&F)" suffix.
+// unmask() restores the spans and fails unless every sentinel came back exactly once.
+class MarkupMasker {
+public:
+    struct Masked {
+        QString text;         // Text sent to the model
+        QStringList spans;    // Original text of sentinel {i}
+        QChar mnemonic;       // Stripped mnemonic character, or null
+    };
+
+    // Sources that already contain "{<digits>}" are passed through unmasked
+    static Masked mask(const QString &source);
+    // Returns false (and leaves result untouched) if a sentinel was lost or duplicated
+    static bool unmask(const QString &translation, const Masked &masked, QString *result);
+};
+
+#endif // MARKUPMASKER_H
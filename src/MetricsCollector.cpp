@@ -0,0 +1,289 @@
+#include "MetricsCollector.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <algorithm>
+#include <limits>
+
+namespace {
+// Samples kept for percentiles
+const int kWindowSize = 512;
+const char kMetricPrefix[] = "llmtranslator_";
+
+const QVector<double> kSecondBounds = {0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 120, 300};
+const QVector<double> kTokenBounds = {128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768};
+const QVector<double> kRateBounds = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+
+QByteArray number(double value)
+{
+    return QByteArray::number(value, 'g', 10);
+}
+
+bool writeFile(const QString &filePath, const QByteArray &data, QString *errorString)
+{
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        if (errorString) *errorString = "Failed to save file: " + file.errorString();
+        return false;
+    }
+    return true;
+}
+}
+
+MetricsCollector::Histogram::Histogram()
+    : Histogram(QVector<double>())
+{
+}
+
+MetricsCollector::Histogram::Histogram(const QVector<double> &bounds)
+    : m_bounds(bounds)
+    , m_buckets(bounds.size() + 1, 0)
+    , m_windowPos(0)
+    , m_count(0)
+    , m_sum(0)
+    , m_min(0)
+    , m_max(0)
+{
+}
+
+void MetricsCollector::Histogram::add(double value)
+{
+    const int bucket = int(std::lower_bound(m_bounds.begin(), m_bounds.end(), value) - m_bounds.begin());
+    m_buckets[bucket]++;
+
+    if (m_window.size() < kWindowSize) {
+        m_window.append(value);
+    } else {
+        m_window[m_windowPos] = value;
+        m_windowPos = (m_windowPos + 1) % kWindowSize;
+    }
+
+    m_min = m_count == 0 ? value : qMin(m_min, value);
+    m_max = m_count == 0 ? value : qMax(m_max, value);
+    m_sum += value;
+    m_count++;
+}
+
+double MetricsCollector::Histogram::percentile(double p) const
+{
+    if (m_window.isEmpty()) return 0;
+    QVector<double> sorted = m_window;
+    std::sort(sorted.begin(), sorted.end());
+    const int index = qBound(0, int(p / 100.0 * (sorted.size() - 1) + 0.5), sorted.size() - 1);
+    return sorted.at(index);
+}
+
+QJsonObject MetricsCollector::Histogram::toJson() const
+{
+    QJsonObject obj;
+    obj["count"] = m_count;
+    obj["sum"] = m_sum;
+    obj["min"] = m_min;
+    obj["max"] = m_max;
+    obj["mean"] = m_count > 0 ? m_sum / m_count : 0.0;
+    obj["p50"] = percentile(50);
+    obj["p90"] = percentile(90);
+    obj["p99"] = percentile(99);
+
+    QJsonArray buckets;
+    for (int i = 0; i < m_buckets.size(); ++i) {
+        QJsonObject bucket;
+        bucket["le"] = i < m_bounds.size() ? QJsonValue(m_bounds.at(i)) : QJsonValue("+Inf");
+        bucket["count"] = m_buckets.at(i);
+        buckets.append(bucket);
+    }
+    obj["buckets"] = buckets;
+    return obj;
+}
+
+void MetricsCollector::Histogram::writePrometheus(QByteArray &out, const QByteArray &name, const QByteArray &help) const
+{
+    const QByteArray metric = kMetricPrefix + name;
+    out += "# HELP " + metric + ' ' + help + '\n';
+    out += "# TYPE " + metric + " histogram\n";
+    int cumulative = 0;
+    for (int i = 0; i < m_buckets.size(); ++i) {
+        cumulative += m_buckets.at(i);
+        const QByteArray le = i < m_bounds.size() ? number(m_bounds.at(i)) : QByteArray("+Inf");
+        out += metric + "_bucket{le=\"" + le + "\"} " + QByteArray::number(cumulative) + '\n';
+    }
+    out += metric + "_sum " + number(m_sum) + '\n';
+    out += metric + "_count " + QByteArray::number(m_count) + '\n';
+}
+
+MetricsCollector::MetricsCollector()
+    : m_promptCaching(false)
+{
+    reset();
+}
+
+void MetricsCollector::reset()
+{
+    m_batches = 0;
+    m_items = 0;
+    m_applied = 0;
+    m_promptTokenTotal = 0;
+    m_outputTokenTotal = 0;
+    m_estimatedPromptTokens = 0;
+    m_measuredPromptTokens = 0;
+    m_coldPromptRatio = -1;
+    m_promptEvalNs = 0;
+    m_evalNs = 0;
+    m_loadNs = 0;
+    m_totalNs = 0;
+
+    m_wall = Histogram(kSecondBounds);
+    m_ttfb = Histogram(kSecondBounds);
+    m_promptTokens = Histogram(kTokenBounds);
+    m_outputTokens = Histogram(kTokenBounds);
+    m_tokensPerSecond = Histogram(kRateBounds);
+    m_itemsPerSecond = Histogram(kRateBounds);
+}
+
+void MetricsCollector::recordBatch(int items, int applied, qint64 wallMs, qint64 ttfbMs, int estimatedPromptTokens,
+                                   const QJsonObject &ollamaTiming)
+{
+    // Ollama reports counts and nanosecond durations as JSON numbers
+    const qint64 promptTokens = qint64(ollamaTiming.value("prompt_eval_count").toDouble());
+    const qint64 outputTokens = qint64(ollamaTiming.value("eval_count").toDouble());
+    const qint64 evalNs = qint64(ollamaTiming.value("eval_duration").toDouble());
+
+    m_batches++;
+    m_items += items;
+    m_applied += applied;
+    m_promptTokenTotal += promptTokens;
+    m_outputTokenTotal += outputTokens;
+    m_promptEvalNs += qint64(ollamaTiming.value("prompt_eval_duration").toDouble());
+    m_evalNs += evalNs;
+    m_loadNs += qint64(ollamaTiming.value("load_duration").toDouble());
+    m_totalNs += qint64(ollamaTiming.value("total_duration").toDouble());
+
+    const double wallSeconds = qMax<qint64>(1, wallMs) / 1000.0;
+    m_wall.add(wallSeconds);
+    if (ttfbMs >= 0) {
+        m_ttfb.add(ttfbMs / 1000.0);
+    }
+    m_itemsPerSecond.add(applied / wallSeconds);
+
+    // Servers without timing fields (other APIs) only get wall-clock metrics
+    if (ollamaTiming.contains("eval_count")) {
+        if (estimatedPromptTokens > 0) {
+            m_estimatedPromptTokens += estimatedPromptTokens;
+            m_measuredPromptTokens += promptTokens;
+            if (m_coldPromptRatio < 0) m_coldPromptRatio = double(promptTokens) / estimatedPromptTokens;
+        }
+        m_promptTokens.add(promptTokens);
+        m_outputTokens.add(outputTokens);
+        m_tokensPerSecond.add(evalNs > 0 ? outputTokens * 1e9 / evalNs : outputTokens / wallSeconds);
+    }
+}
+
+double MetricsCollector::tokensPerSecond() const
+{
+    return m_evalNs > 0 ? m_outputTokenTotal * 1e9 / m_evalNs : 0.0;
+}
+
+qint64 MetricsCollector::estimatedReusedPromptTokens() const
+{
+    // A single batch has nothing to compare with; without caching there is nothing to reuse
+    if (!m_promptCaching || m_batches < 2 || m_coldPromptRatio < 0) return 0;
+    return qMax<qint64>(0, qint64(m_coldPromptRatio * m_estimatedPromptTokens) - m_measuredPromptTokens);
+}
+
+double MetricsCollector::estimatedPromptEvalSecondsSaved() const
+{
+    if (m_promptTokenTotal <= 0 || m_promptEvalNs <= 0) return 0.0;
+    return estimatedReusedPromptTokens() * (double(m_promptEvalNs) / m_promptTokenTotal) / 1e9;
+}
+
+QString MetricsCollector::summaryLine() const
+{
+    QString line = QString("Metrics: %1 batches, %2 prompt / %3 output tokens, %4 tokens/s, "
+                           "batch wall p50 %5 s / p90 %6 s, first byte p50 %7 s")
+        .arg(m_batches).arg(m_promptTokenTotal).arg(m_outputTokenTotal)
+        .arg(tokensPerSecond(), 0, 'f', 1)
+        .arg(m_wall.percentile(50), 0, 'f', 2).arg(m_wall.percentile(90), 0, 'f', 2)
+        .arg(m_ttfb.percentile(50), 0, 'f', 2);
+    if (m_loadNs > 0) {
+        // Model load is not generation time; a warm model reports (close to) zero
+        line += QString(", model load %1 s").arg(m_loadNs / 1e9, 0, 'f', 1);
+    }
+    const qint64 reused = estimatedReusedPromptTokens();
+    if (reused > 0) {
+        line += QString(", prompt cache reused ~%1% of prompt tokens (estimated, ~%2 s prompt eval saved)")
+            .arg(100.0 * reused / (reused + m_measuredPromptTokens), 0, 'f', 0)
+            .arg(estimatedPromptEvalSecondsSaved(), 0, 'f', 1);
+    }
+    return line;
+}
+
+QJsonObject MetricsCollector::summary() const
+{
+    QJsonObject totals;
+    totals["batches"] = m_batches;
+    totals["items"] = double(m_items);
+    totals["items_applied"] = double(m_applied);
+    totals["prompt_tokens"] = double(m_promptTokenTotal);
+    totals["prompt_tokens_estimated"] = double(m_estimatedPromptTokens);
+    totals["prompt_tokens_reused_estimated"] = double(estimatedReusedPromptTokens());
+    totals["prompt_eval_seconds_saved_estimated"] = estimatedPromptEvalSecondsSaved();
+    totals["output_tokens"] = double(m_outputTokenTotal);
+    totals["prompt_eval_seconds"] = m_promptEvalNs / 1e9;
+    totals["eval_seconds"] = m_evalNs / 1e9;
+    totals["load_seconds"] = m_loadNs / 1e9;
+    totals["server_total_seconds"] = m_totalNs / 1e9;
+    totals["tokens_per_second"] = tokensPerSecond();
+
+    QJsonObject histograms;
+    histograms["batch_wall_seconds"] = m_wall.toJson();
+    histograms["batch_ttfb_seconds"] = m_ttfb.toJson();
+    histograms["batch_prompt_tokens"] = m_promptTokens.toJson();
+    histograms["batch_output_tokens"] = m_outputTokens.toJson();
+    histograms["batch_tokens_per_second"] = m_tokensPerSecond.toJson();
+    histograms["batch_items_per_second"] = m_itemsPerSecond.toJson();
+
+    QJsonObject obj;
+    obj["totals"] = totals;
+    obj["histograms"] = histograms;
+    return obj;
+}
+
+QByteArray MetricsCollector::prometheusText() const
+{
+    QByteArray out;
+    auto counter = [&out](const QByteArray &name, const QByteArray &help, double value) {
+        const QByteArray metric = kMetricPrefix + name;
+        out += "# HELP " + metric + ' ' + help + '\n';
+        out += "# TYPE " + metric + " counter\n";
+        out += metric + ' ' + number(value) + '\n';
+    };
+    counter("batches_total", "Batch requests completed.", m_batches);
+    counter("items_applied_total", "Translations applied from model answers.", m_applied);
+    counter("prompt_tokens_total", "Prompt tokens evaluated by the model.", m_promptTokenTotal);
+    counter("output_tokens_total", "Tokens generated by the model.", m_outputTokenTotal);
+    counter("prompt_tokens_reused_estimated_total", "Prompt tokens served from the server's prompt cache, estimated from the first batch.",
+            estimatedReusedPromptTokens());
+    counter("eval_seconds_total", "Generation time reported by the server.", m_evalNs / 1e9);
+    counter("load_seconds_total", "Model load time reported by the server.", m_loadNs / 1e9);
+
+    m_wall.writePrometheus(out, "batch_wall_seconds", "Wall time of a batch request.");
+    m_ttfb.writePrometheus(out, "batch_ttfb_seconds", "Time to the first response byte of a batch request.");
+    m_promptTokens.writePrometheus(out, "batch_prompt_tokens", "Prompt tokens per batch.");
+    m_outputTokens.writePrometheus(out, "batch_output_tokens", "Output tokens per batch.");
+    m_tokensPerSecond.writePrometheus(out, "batch_tokens_per_second", "Generation speed per batch.");
+    m_itemsPerSecond.writePrometheus(out, "batch_items_per_second", "Applied translations per second of batch wall time.");
+    return out;
+}
+
+bool MetricsCollector::writeJson(const QString &filePath, QString *errorString) const
+{
+    return writeFile(filePath, QJsonDocument(summary()).toJson(), errorString);
+}
+
+bool MetricsCollector::writePrometheus(const QString &filePath, QString *errorString) const
+{
+    return writeFile(filePath, prometheusText(), errorString);
+}
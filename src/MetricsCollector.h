@@ -0,0 +1,105 @@
+#ifndef METRICSCOLLECTOR_H
+#define METRICSCOLLECTOR_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+// Per-batch performance metrics of a run, fed from the timing fields Ollama returns
+// with the last (or only) chunk of every answer: prompt_eval_count / _duration,
+// eval_count / _duration, load_duration and total_duration (all durations in ns).
+// prompt_eval_count only covers tokens that were not served from the server's prompt
+// cache. With prompt caching on, the first batch of the run is evaluated cold, so its
+// prompt_eval_count against its estimated prompt size calibrates the estimate. The
+// other batches' reuse is then estimated as their calibrated prompt size minus the
+// prompt_eval_count they report. It is an estimate, and is labelled as one.
+//
+// Each metric is kept as a fixed-bucket histogram (exported as is) plus a rolling
+// window of the most recent samples for percentiles. summary() is a JSON object,
+// prometheusText() the same data in the Prometheus text exposition format.
+class MetricsCollector {
+public:
+    class Histogram {
+    public:
+        Histogram();
+        explicit Histogram(const QVector<double> &bounds);
+
+        void add(double value);
+        int count() const { return m_count; }
+        double sum() const { return m_sum; }
+        double min() const { return m_min; }
+        double max() const { return m_max; }
+        // Percentile (0..100) of the rolling window
+        double percentile(double p) const;
+
+        QJsonObject toJson() const;
+        void writePrometheus(QByteArray &out, const QByteArray &name, const QByteArray &help) const;
+
+    private:
+        QVector<double> m_bounds;   // Upper bounds of the buckets, +Inf is implicit
+        QVector<int> m_buckets;     // Non-cumulative counts, one more than m_bounds
+        QVector<double> m_window;   // Ring buffer of the last samples
+        int m_windowPos;
+        int m_count;
+        double m_sum;
+        double m_min;
+        double m_max;
+    };
+
+    MetricsCollector();
+
+    void reset();
+    // Reuse is only reported for runs that send a stable prefix (/api/chat); reset() keeps the setting
+    void setPromptCaching(bool enabled) { m_promptCaching = enabled; }
+    // ttfbMs is -1 when no byte arrived before the reply finished
+    void recordBatch(int items, int applied, qint64 wallMs, qint64 ttfbMs, int estimatedPromptTokens,
+                     const QJsonObject &ollamaTiming);
+
+    int batchCount() const { return m_batches; }
+    // Aggregate generation speed over all batches (eval_count / eval_duration)
+    double tokensPerSecond() const;
+    // Estimated prompt tokens the server did not have to evaluate, and the time that
+    // saved at the measured prompt evaluation speed of the run; 0 without prompt caching
+    qint64 estimatedReusedPromptTokens() const;
+    double estimatedPromptEvalSecondsSaved() const;
+
+    const Histogram &wallSeconds() const { return m_wall; }
+    const Histogram &ttfbSeconds() const { return m_ttfb; }
+    const Histogram &promptTokens() const { return m_promptTokens; }
+    const Histogram &outputTokens() const { return m_outputTokens; }
+    const Histogram &tokensPerSecondPerBatch() const { return m_tokensPerSecond; }
+    const Histogram &itemsPerSecond() const { return m_itemsPerSecond; }
+
+    // One line for the log
+    QString summaryLine() const;
+    QJsonObject summary() const;
+    QByteArray prometheusText() const;
+
+    bool writeJson(const QString &filePath, QString *errorString = nullptr) const;
+    bool writePrometheus(const QString &filePath, QString *errorString = nullptr) const;
+
+private:
+    bool m_promptCaching;
+    int m_batches;
+    qint64 m_items;
+    qint64 m_applied;
+    qint64 m_promptTokenTotal;
+    qint64 m_outputTokenTotal;
+    qint64 m_estimatedPromptTokens;
+    qint64 m_measuredPromptTokens;  // prompt_eval_count of the batches with an estimate
+    double m_coldPromptRatio;       // prompt_eval_count / estimate of the first (cold) batch, -1 before it
+    qint64 m_promptEvalNs;
+    qint64 m_evalNs;
+    qint64 m_loadNs;
+    qint64 m_totalNs;
+
+    Histogram m_wall;
+    Histogram m_ttfb;
+    Histogram m_promptTokens;
+    Histogram m_outputTokens;
+    Histogram m_tokensPerSecond;
+    Histogram m_itemsPerSecond;
+};
+
+#endif // METRICSCOLLECTOR_H
@@ -0,0 +1,95 @@
+#include "ResponseParser.h"
+#include <QJsonDocument>
+
+TranslationStreamParser::TranslationStreamParser()
+{
+    reset();
+}
+
+void TranslationStreamParser::reset()
+{
+    m_buffer.clear();
+    m_pos = 0;
+    m_stack.clear();
+    m_inString = false;
+    m_escape = false;
+    m_objectStart = -1;
+    m_objectDepth = 0;
+}
+
+QList<QJsonObject> TranslationStreamParser::feed(const QByteArray &text)
+{
+    QList<QJsonObject> objects;
+    m_buffer.append(text);
+    scan(m_buffer.constData(), m_buffer.size(), &objects);
+
+    // Only the unfinished object has to be kept
+    const int keepFrom = m_objectStart >= 0 ? m_objectStart : m_pos;
+    if (keepFrom > 0) {
+        m_buffer.remove(0, keepFrom);
+        m_pos -= keepFrom;
+        if (m_objectStart >= 0) m_objectStart = 0;
+    }
+    return objects;
+}
+
+QList<QJsonObject> TranslationStreamParser::parse(const QByteArray &text, bool *complete)
+{
+    QList<QJsonObject> objects;
+    TranslationStreamParser parser;
+    parser.scan(text.constData(), text.size(), &objects);
+    if (complete) *complete = parser.m_stack.isEmpty() && !parser.m_inString;
+    return objects;
+}
+
+void TranslationStreamParser::scan(const char *data, int size, QList<QJsonObject> *objects)
+{
+    for (; m_pos < size; ++m_pos) {
+        const char ch = data[m_pos];
+
+        if (m_inString) {
+            if (m_escape) {
+                m_escape = false;
+            } else if (ch == '\\') {
+                m_escape = true;
+            } else if (ch == '"') {
+                m_inString = false;
+            }
+            continue;
+        }
+
+        switch (ch) {
+        case '"':
+            m_inString = true;
+            break;
+        case '{':
+            if (m_objectStart < 0 && !m_stack.isEmpty() && m_stack.last() == '[') {
+                m_objectStart = m_pos;
+                m_objectDepth = m_stack.size() + 1;
+            }
+            m_stack.append(ch);
+            break;
+        case '[':
+            m_stack.append(ch);
+            break;
+        case '}':
+            if (m_objectStart >= 0 && m_stack.size() == m_objectDepth) {
+                // A malformed element is dropped; the scan goes on with the next one
+                QJsonParseError error;
+                QJsonDocument doc = QJsonDocument::fromJson(
+                    QByteArray::fromRawData(data + m_objectStart, m_pos - m_objectStart + 1), &error);
+                if (error.error == QJsonParseError::NoError && doc.isObject()) {
+                    objects->append(doc.object());
+                }
+                m_objectStart = -1;
+            }
+            if (!m_stack.isEmpty()) m_stack.removeLast();
+            break;
+        case ']':
+            if (!m_stack.isEmpty()) m_stack.removeLast();
+            break;
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef RESPONSEPARSER_H
+#define RESPONSEPARSER_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QVector>
+
+// Incremental extractor for the translation objects in a model answer.
+//
+// The model writes {"translations": [{"id": 1, "translation": "..."}, ...]} (or a
+// bare array) a few characters at a time. Every object that is a direct element
+// of an array is returned as soon as its closing brace arrives, so results can be
+// applied while the rest of the answer is still being generated.
+//
+// The same scan serves complete answers: surrounding text (markdown fences, prose)
+// is skipped, and an answer cut off at the context limit or with a malformed
+// element still yields every complete object before and after it.
+class TranslationStreamParser {
+public:
+    TranslationStreamParser();
+
+    void reset();
+    // Appends model output; returns the objects completed by this chunk
+    QList<QJsonObject> feed(const QByteArray &text);
+
+    // One pass over a complete answer, in place (no buffered copy); *complete is set
+    // to false if the answer ends inside an array or object
+    static QList<QJsonObject> parse(const QByteArray &text, bool *complete = nullptr);
+
+private:
+    // Scans data[m_pos, size) and appends the completed objects
+    void scan(const char *data, int size, QList<QJsonObject> *objects);
+
+    QByteArray m_buffer;
+    int m_pos;              // Next byte of m_buffer to scan
+    QVector<char> m_stack;  // Open '{' / '[' outside of strings
+    bool m_inString;
+    bool m_escape;
+    int m_objectStart;      // Start of the array element object being read, or -1
+    int m_objectDepth;      // m_stack size inside that object
+};
+
+#endif // RESPONSEPARSER_H
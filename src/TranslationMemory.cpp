@@ -0,0 +1,189 @@
+#include "TranslationMemory.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+const char kMagic[] = "LLMTM001";
+const int kMagicSize = 8;
+const int kKeySize = 20; // SHA-1
+const int kRecordHeaderSize = kKeySize + 4;
+}
+
+TranslationMemory::TranslationMemory()
+{
+}
+
+TranslationMemory::~TranslationMemory()
+{
+    close();
+}
+
+bool TranslationMemory::open(const QString &filePath, QString *errorString)
+{
+    close();
+
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        if (errorString) *errorString = m_file.errorString();
+        return false;
+    }
+
+    if (m_file.size() < kMagicSize) {
+        // New (or unusable) store: start over with a fresh header
+        m_file.resize(0);
+        m_file.write(kMagic, kMagicSize);
+        m_file.flush();
+        return true;
+    }
+
+    const qint64 fileSize = m_file.size();
+    uchar *data = m_file.map(0, fileSize);
+    if (!data) {
+        if (errorString) *errorString = m_file.errorString();
+        m_file.close();
+        return false;
+    }
+
+    if (memcmp(data, kMagic, kMagicSize) != 0) {
+        m_file.unmap(data);
+        m_file.close();
+        if (errorString) *errorString = QString("%1 is not a translation memory file").arg(filePath);
+        return false;
+    }
+
+    qint64 pos = kMagicSize;
+    while (pos + kRecordHeaderSize <= fileSize) {
+        const quint32 length = qFromLittleEndian<quint32>(data + pos + kKeySize);
+        if (pos + kRecordHeaderSize + length > fileSize) break;
+
+        QByteArray key(reinterpret_cast<const char *>(data + pos), kKeySize);
+        m_entries.insert(key, QString::fromUtf8(reinterpret_cast<const char *>(data + pos + kRecordHeaderSize), int(length)));
+        pos += kRecordHeaderSize + length;
+    }
+    m_file.unmap(data);
+
+    if (pos != fileSize) {
+        // Drop the partially written tail record
+        m_file.resize(pos);
+    }
+    m_file.seek(pos);
+    return true;
+}
+
+void TranslationMemory::close()
+{
+    if (m_file.isOpen()) {
+        m_file.flush();
+        m_file.close();
+    }
+    m_entries.clear();
+}
+
+bool TranslationMemory::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+QString TranslationMemory::filePath() const
+{
+    return m_file.fileName();
+}
+
+QByteArray TranslationMemory::makeKey(const QString &source, const QString &context,
+                                      const QString &targetLang, const QString &modelName)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(source.toUtf8());
+    hash.addData("\x1f", 1);
+    hash.addData(context.toUtf8());
+    hash.addData("\x1f", 1);
+    hash.addData(targetLang.toUtf8());
+    hash.addData("\x1f", 1);
+    hash.addData(modelName.toUtf8());
+    return hash.result();
+}
+
+bool TranslationMemory::lookup(const QByteArray &key, QString *translation) const
+{
+    auto it = m_entries.constFind(key);
+    if (it == m_entries.constEnd()) return false;
+    if (translation) *translation = it.value();
+    return true;
+}
+
+bool TranslationMemory::insert(const QByteArray &key, const QString &translation)
+{
+    if (!m_file.isOpen() || key.size() != kKeySize) return false;
+
+    auto it = m_entries.constFind(key);
+    if (it != m_entries.constEnd() && it.value() == translation) return true;
+
+    const QByteArray payload = translation.toUtf8();
+    uchar lengthLE[4];
+    qToLittleEndian<quint32>(quint32(payload.size()), lengthLE);
+
+    QByteArray record;
+    record.reserve(kRecordHeaderSize + payload.size());
+    record.append(key);
+    record.append(reinterpret_cast<const char *>(lengthLE), 4);
+    record.append(payload);
+    if (m_file.write(record) != record.size()) return false;
+
+    m_entries.insert(key, translation);
+    return true;
+}
+
+void TranslationMemory::flush()
+{
+    if (m_file.isOpen()) m_file.flush();
+}
+
+bool TranslationMemory::sync()
+{
+    if (!m_file.isOpen() || !m_file.flush()) return false;
+#ifdef Q_OS_WIN
+    return _commit(m_file.handle()) == 0;
+#else
+    return ::fsync(m_file.handle()) == 0;
+#endif
+}
+
+bool TranslationMemory::remove()
+{
+    const QString path = m_file.fileName();
+    close();
+    return path.isEmpty() || QFile::remove(path);
+}
+
+int TranslationMemory::size() const
+{
+    return m_entries.size();
+}
+
+QString TranslationMemory::defaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/translation_memory.tm";
+}
+
+QString TranslationMemory::journalPath(const QString &filePath, const QString &targetLang, const QString &modelName)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QFileInfo(filePath).absoluteFilePath().toUtf8());
+    hash.addData("\x1f", 1);
+    hash.addData(targetLang.toUtf8());
+    hash.addData("\x1f", 1);
+    hash.addData(modelName.toUtf8());
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+           + "/journals/" + QString::fromLatin1(hash.result().toHex()) + ".journal";
+}
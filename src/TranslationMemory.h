@@ -0,0 +1,51 @@
+#ifndef TRANSLATIONMEMORY_H
+#define TRANSLATIONMEMORY_H
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+// Persistent translation memory shared by all runs and projects. The same store
+// format also serves as the per-run checkpoint journal (see journalPath()).
+//
+// The store is an append-only file of hashed records:
+//   header  : "LLMTM001"
+//   record  : 20-byte SHA-1 key | quint32 (LE) payload length | UTF-8 translation
+// The key is derived from (source, context, target language, model). Later records
+// override earlier ones with the same key. On open the file is memory-mapped and
+// indexed once; a torn record at the end (e.g. after a crash) is cut off.
+class TranslationMemory {
+public:
+    TranslationMemory();
+    ~TranslationMemory();
+
+    bool open(const QString &filePath, QString *errorString = nullptr);
+    void close();
+    bool isOpen() const;
+    QString filePath() const;
+
+    static QByteArray makeKey(const QString &source, const QString &context,
+                              const QString &targetLang, const QString &modelName);
+
+    bool lookup(const QByteArray &key, QString *translation) const;
+    // Appends a record; unchanged entries are not written again
+    bool insert(const QByteArray &key, const QString &translation);
+    void flush();
+    // Flush and force the data to disk (fsync)
+    bool sync();
+    // Close and delete the file
+    bool remove();
+
+    int size() const;
+
+    // <AppData>/translation_memory.tm
+    static QString defaultPath();
+    // <AppData>/journals/<hash>.journal, one per (file, target language, model)
+    static QString journalPath(const QString &filePath, const QString &targetLang, const QString &modelName);
+
+private:
+    QFile m_file;
+    QHash<QByteArray, QString> m_entries;
+};
+
+#endif // TRANSLATIONMEMORY_H
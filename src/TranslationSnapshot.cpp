@@ -0,0 +1,144 @@
+#include "TranslationSnapshot.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+
+namespace {
+const char kMagic[] = "LLMSNP02";
+const int kMagicSize = 8;
+const int kKeySize = 20; // SHA-1
+const int kRecordHeaderSize = 2 * kKeySize + 4;
+
+QByteArray hashPair(const QString &first, const QString &second)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(first.toUtf8());
+    hash.addData("\x1f", 1);
+    hash.addData(second.toUtf8());
+    return hash.result();
+}
+}
+
+QByteArray TranslationSnapshot::makeKey(const QString &context, const QString &source)
+{
+    return hashPair(context, source);
+}
+
+bool TranslationSnapshot::load(const QString &filePath, QString *errorString)
+{
+    clear();
+
+    QFile file(filePath);
+    if (!file.exists()) return true;
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    const QByteArray data = file.readAll();
+    if (!data.startsWith(QByteArray::fromRawData(kMagic, kMagicSize))) {
+        if (errorString) *errorString = QString("%1 is not a translation snapshot").arg(filePath);
+        return false;
+    }
+
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    int pos = kMagicSize;
+    while (pos + kRecordHeaderSize <= data.size()) {
+        const quint32 length = qFromLittleEndian<quint32>(bytes + pos + 2 * kKeySize);
+        if (qint64(pos) + kRecordHeaderSize + length > data.size()) break;
+
+        insertEntry(data.mid(pos, kKeySize), data.mid(pos + kKeySize, kKeySize),
+                    QString::fromUtf8(data.constData() + pos + kRecordHeaderSize, int(length)));
+        pos += kRecordHeaderSize + int(length);
+    }
+    if (pos != data.size()) {
+        // Snapshots are written atomically, so a short record means a foreign or damaged file
+        clear();
+        if (errorString) *errorString = QString("%1 is truncated").arg(filePath);
+        return false;
+    }
+    return true;
+}
+
+bool TranslationSnapshot::save(const QString &filePath, QString *errorString) const
+{
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    QByteArray data(kMagic, kMagicSize);
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        const QByteArray payload = it.value().translation.toUtf8();
+        uchar lengthLE[4];
+        qToLittleEndian<quint32>(quint32(payload.size()), lengthLE);
+        data.append(it.key());
+        data.append(it.value().identity);
+        data.append(reinterpret_cast<const char *>(lengthLE), 4);
+        data.append(payload);
+    }
+    if (file.write(data) != data.size() || !file.commit()) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void TranslationSnapshot::clear()
+{
+    m_entries.clear();
+    m_sources.clear();
+}
+
+bool TranslationSnapshot::isEmpty() const
+{
+    return m_entries.isEmpty();
+}
+
+int TranslationSnapshot::size() const
+{
+    return m_entries.size();
+}
+
+bool TranslationSnapshot::lookup(const QByteArray &key, QString *translation) const
+{
+    auto it = m_entries.constFind(key);
+    if (it == m_entries.constEnd()) return false;
+    if (translation) *translation = it.value().translation;
+    return true;
+}
+
+void TranslationSnapshot::insert(const QString &context, const QString &source, const QString &translation)
+{
+    insertEntry(makeKey(context, source), hashPair(context, translation), translation);
+}
+
+void TranslationSnapshot::insertEntry(const QByteArray &key, const QByteArray &identity, const QString &translation)
+{
+    m_entries.insert(key, Entry{identity, translation});
+    m_sources.insert(identity, key);
+}
+
+bool TranslationSnapshot::isStale(const QString &context, const QString &source, const QString &translation) const
+{
+    const QByteArray key = makeKey(context, source);
+    if (m_entries.contains(key)) return false;
+    auto it = m_sources.constFind(hashPair(context, translation));
+    return it != m_sources.constEnd() && it.value() != key;
+}
+
+QString TranslationSnapshot::snapshotPath(const QString &filePath, const QString &targetLang)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QFileInfo(filePath).absoluteFilePath().toUtf8());
+    hash.addData("\x1f", 1);
+    hash.addData(targetLang.toUtf8());
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)
+           + "/snapshots/" + QString::fromLatin1(hash.result().toHex()) + ".snapshot";
+}
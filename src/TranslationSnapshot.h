@@ -0,0 +1,53 @@
+#ifndef TRANSLATIONSNAPSHOT_H
+#define TRANSLATIONSNAPSHOT_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+// Translations of one (input file, target language) as of the last save, used to
+// translate only what changed after the next lupdate.
+//
+// Every record also carries a hash of (context, translation). A finished message whose
+// source is not in the snapshot but whose translation was saved there for another
+// source of the same context is stale (the source was edited after translating); one
+// that matches nothing was translated elsewhere, e.g. by hand in Linguist, and is kept.
+//
+// Unlike the translation memory the snapshot is rewritten as a whole on every save,
+// so it only holds the messages of the current file:
+//   header  : "LLMSNP02"
+//   record  : 20-byte SHA-1 of (context, source) | 20-byte SHA-1 of (context, translation)
+//             | quint32 (LE) payload length | UTF-8 translation
+class TranslationSnapshot {
+public:
+    static QByteArray makeKey(const QString &context, const QString &source);
+
+    // A missing file is an empty snapshot, not an error
+    bool load(const QString &filePath, QString *errorString = nullptr);
+    // Atomic: the previous snapshot stays intact if writing fails
+    bool save(const QString &filePath, QString *errorString = nullptr) const;
+    void clear();
+
+    bool isEmpty() const;
+    int size() const;
+    bool lookup(const QByteArray &key, QString *translation) const;
+    void insert(const QString &context, const QString &source, const QString &translation);
+    // True if translation was saved for a different source of the same context
+    bool isStale(const QString &context, const QString &source, const QString &translation) const;
+
+    // <AppData>/snapshots/<hash>.snapshot, one per (file, target language)
+    static QString snapshotPath(const QString &filePath, const QString &targetLang);
+
+private:
+    struct Entry {
+        QByteArray identity; // SHA-1 of (context, translation)
+        QString translation;
+    };
+
+    void insertEntry(const QByteArray &key, const QByteArray &identity, const QString &translation);
+
+    QHash<QByteArray, Entry> m_entries;
+    QHash<QByteArray, QByteArray> m_sources; // Identity -> key of the source it was saved for
+};
+
+#endif // TRANSLATIONSNAPSHOT_H
@@ -0,0 +1,175 @@
+#include "TranslationValidator.h"
+#include <QRegularExpression>
+#include <QStringList>
+
+namespace {
+// Length checks only make sense from this many source characters on
+const int kMinLengthCheckChars = 12;
+const double kMinLengthRatio = 0.2;
+const double kMaxLengthRatio = 5.0;
+// Share of the letters that must be in a script of the target language
+const double kMinScriptShare = 0.5;
+
+struct LanguageScripts {
+    const char *name;   // English name, matched as a substring ("Simplified Chinese")
+    const char *code;   // ISO 639-1 code, matched before '_' / '-' ("zh_CN")
+    QChar::Script scripts[3];
+};
+
+const LanguageScripts kLanguages[] = {
+    {"chinese", "zh", {QChar::Script_Han}},
+    {"japanese", "ja", {QChar::Script_Han, QChar::Script_Hiragana, QChar::Script_Katakana}},
+    {"korean", "ko", {QChar::Script_Hangul, QChar::Script_Han}},
+    {"russian", "ru", {QChar::Script_Cyrillic}},
+    {"ukrainian", "uk", {QChar::Script_Cyrillic}},
+    {"bulgarian", "bg", {QChar::Script_Cyrillic}},
+    {"greek", "el", {QChar::Script_Greek}},
+    {"arabic", "ar", {QChar::Script_Arabic}},
+    {"persian", "fa", {QChar::Script_Arabic}},
+    {"hebrew", "he", {QChar::Script_Hebrew}},
+    {"thai", "th", {QChar::Script_Thai}},
+    {"hindi", "hi", {QChar::Script_Devanagari}},
+    {"english", "en", {QChar::Script_Latin}},
+    {"german", "de", {QChar::Script_Latin}},
+    {"french", "fr", {QChar::Script_Latin}},
+    {"spanish", "es", {QChar::Script_Latin}},
+    {"italian", "it", {QChar::Script_Latin}},
+    {"portuguese", "pt", {QChar::Script_Latin}},
+    {"dutch", "nl", {QChar::Script_Latin}},
+    {"polish", "pl", {QChar::Script_Latin}},
+    {"czech", "cs", {QChar::Script_Latin}},
+    {"swedish", "sv", {QChar::Script_Latin}},
+    {"danish", "da", {QChar::Script_Latin}},
+    {"finnish", "fi", {QChar::Script_Latin}},
+    {"turkish", "tr", {QChar::Script_Latin}},
+    {"vietnamese", "vi", {QChar::Script_Latin}},
+    {"indonesian", "id", {QChar::Script_Latin}},
+    {"malayalam", "ml", {QChar::Script_Malayalam}},   // Before "malay"
+    {"malay", "ms", {QChar::Script_Latin}},
+    {"romanian", "ro", {QChar::Script_Latin}},
+    {"hungarian", "hu", {QChar::Script_Latin}},
+};
+
+const QRegularExpression &argPattern()
+{
+    static const QRegularExpression pattern("%L?(?:[1-9][0-9]?|n)");
+    return pattern;
+}
+
+const QRegularExpression &tagPattern()
+{
+    static const QRegularExpression pattern("</?[!?]?[A-Za-z][^<>]*>");
+    return pattern;
+}
+
+QStringList captures(const QRegularExpression &pattern, const QString &text)
+{
+    QStringList list;
+    QRegularExpressionMatchIterator it = pattern.globalMatch(text);
+    while (it.hasNext()) {
+        list.append(it.next().captured());
+    }
+    list.sort();
+    return list;
+}
+
+// Text without tags, entities and Qt arguments
+QString plainText(const QString &text)
+{
+    static const QRegularExpression entity("&(?:[A-Za-z][A-Za-z0-9]*|#[0-9]+|#[xX][0-9A-Fa-f]+);");
+    QString plain = text;
+    plain.remove(tagPattern());
+    plain.remove(entity);
+    plain.remove(argPattern());
+    return plain.simplified();
+}
+
+const LanguageScripts *findLanguage(const QString &language)
+{
+    const QString lang = language.trimmed().toLower();
+    const QString code = lang.section(QRegularExpression("[_-]"), 0, 0);
+    for (const LanguageScripts &entry : kLanguages) {
+        if (lang.contains(QLatin1String(entry.name)) || code == QLatin1String(entry.code)) return &entry;
+    }
+    return nullptr;
+}
+
+// Runs of letters in one script: "打开Qt Creator" is "打开", "Qt", "Creator"
+QStringList letterRuns(const QString &text)
+{
+    QStringList runs;
+    QString run;
+    for (QChar ch : text) {
+        if (!ch.isLetter() || (!run.isEmpty() && ch.script() != run.at(run.size() - 1).script())) {
+            if (!run.isEmpty()) runs.append(run);
+            run.clear();
+        }
+        if (ch.isLetter()) run.append(ch);
+    }
+    if (!run.isEmpty()) runs.append(run);
+    return runs;
+}
+
+// Display width: CJK and other wide scripts count twice
+int width(const QString &text)
+{
+    int w = 0;
+    for (QChar ch : text) {
+        w += ch.unicode() < 0x2E80 ? 1 : 2;
+    }
+    return w;
+}
+}
+
+TranslationValidator::TranslationValidator(const QString &targetLang, const QString &sourceLang)
+    : m_sameLanguage(false)
+{
+    const LanguageScripts *target = findLanguage(targetLang);
+    if (target) {
+        for (QChar::Script script : target->scripts) {
+            if (script != QChar::Script_Unknown) m_scripts.append(script);
+        }
+        m_sameLanguage = target == findLanguage(sourceLang.isEmpty() ? QString("en") : sourceLang);
+    }
+}
+
+QString TranslationValidator::check(const QString &source, const QString &translation) const
+{
+    if (translation.trimmed().isEmpty()) return "empty";
+
+    const QString sourceText = plainText(source);
+    const QString text = plainText(translation);
+    // Text without letters (numbers, symbols, arguments) legitimately stays as it is
+    const QStringList sourceRuns = letterRuns(sourceText);
+    if (translation == source && !m_sameLanguage && !sourceRuns.isEmpty()
+        && sourceText.contains(' ') && sourceText.size() >= 4) {
+        return "untranslated";
+    }
+
+    if (captures(argPattern(), source) != captures(argPattern(), translation)) return "placeholders differ";
+    if (captures(tagPattern(), source).size() != captures(tagPattern(), translation).size()) return "markup differs";
+
+    if (sourceText.size() >= kMinLengthCheckChars) {
+        const double ratio = double(width(text)) / width(sourceText);
+        if (ratio < kMinLengthRatio || ratio > kMaxLengthRatio) return "length ratio";
+    }
+
+    // Wrong language: too few letters in a script of the target language
+    if (!m_scripts.isEmpty()) {
+        int letters = 0;
+        int inScript = 0;
+        int copied = 0;    // Letters of runs taken over from the source
+        for (const QString &run : letterRuns(text)) {
+            letters += run.size();
+            if (m_scripts.contains(run.at(0).script())) {
+                inScript += run.size();
+            } else if (sourceRuns.contains(run)) {
+                copied += run.size();
+            }
+        }
+        // A translation with nothing in the target script is judged on all its letters
+        if (inScript > 0) letters -= copied;
+        if (letters >= 3 && inScript < letters * kMinScriptShare) return "wrong script";
+    }
+    return QString();
+}
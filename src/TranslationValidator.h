@@ -0,0 +1,31 @@
+#ifndef TRANSLATIONVALIDATOR_H
+#define TRANSLATIONVALIDATOR_H
+
+#include <QChar>
+#include <QString>
+#include <QVector>
+
+// Cheap local checks of a model translation, used to decide which results of the
+// first (small) model are sent again to the escalation model.
+//
+// A result is suspect if it is empty, identical to a source that has words in it
+// (unless source and target are the same language, e.g. en and en_GB), far shorter
+// or longer than the source, has different Qt arguments or tags than the source,
+// or has less than half of its letters in a script of the target language. Words
+// copied from the source, like product names, do not count against the script
+// share once the translation has some letters in the target script. Languages the
+// validator does not know skip the script check.
+class TranslationValidator {
+public:
+    // An empty source language is English, as in Qt Linguist
+    explicit TranslationValidator(const QString &targetLang = QString(), const QString &sourceLang = QString());
+
+    // Empty if the translation looks fine, otherwise a short reason
+    QString check(const QString &source, const QString &translation) const;
+
+private:
+    QVector<QChar::Script> m_scripts;   // Scripts expected in the target language
+    bool m_sameLanguage;                // Target is a variant of the source language
+};
+
+#endif // TRANSLATIONVALIDATOR_H
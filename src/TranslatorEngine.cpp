@@ -1,172 +1,1320 @@
 #include "TranslatorEngine.h"
+#include "MarkupMasker.h"
+#include "ResponseParser.h"
 #include <QDebug>
-#include <QTextStream>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace {
+// Per-item JSON wrapping ({"id":12,"text":"..."}) in tokens
+const int kItemOverheadTokens = 10;
+// Expected output tokens per input token; translations are often longer than the source
+const double kOutputExpansion = 1.5;
+// Part of the context window kept free for estimation errors
+const double kContextSafetyMargin = 0.15;
+// Backoff before the n-th retry: kRetryBaseMs * 2^(n-1), capped, with jitter
+const int kRetryBaseMs = 1000;
+const int kRetryMaxMs = 30000;
+// Few-shot examples taken from the finished translations of the document
+const int kMaxFewShotExamples = 4;
+const int kMaxFewShotChars = 120;       // Longer sources are not used as examples
+const double kFewShotSimilarity = 0.5;  // Minimum estimated 3-gram similarity
+const int kFewShotReserveTokens = 256;  // Budgeted per batch for the examples
+// Items per batch sent to the escalation model (slower, so smaller batches)
+const int kEscalationBatchItems = 20;
+// Results of one answer from which unmasking and validation go to the thread pool
+const int kParallelCheckResults = 16;
+
+struct ParsedFile {
+    QString path;
+    TsDocument document;
+    QString error;
+};
+
+// Runs on a pool thread (see loadProject())
+ParsedFile parseFile(const QString &path)
+{
+    ParsedFile file;
+    file.path = path;
+    if (!file.document.load(path, &file.error) && file.error.isEmpty()) {
+        file.error = "Failed to parse the file.";
+    }
+    return file;
+}
+
+// A result of the model, as taken from the answer
+struct PendingResult {
+    int id;
+    QString source;
+    QString translation;
+    const TranslationValidator *validator;   // Null: no validation
+};
+
+struct CheckedResult {
+    int id;
+    QString translation;   // Markup restored
+    bool markupKept;
+    QString reason;        // Why the validator flagged it, empty if fine
+};
+
+// Runs on a pool thread for larger answers (see applyResults()); only reads its input
+CheckedResult checkResult(const PendingResult &pending)
+{
+    CheckedResult checked;
+    checked.id = pending.id;
+    checked.markupKept = MarkupMasker::unmask(pending.translation, MarkupMasker::mask(pending.source),
+                                              &checked.translation);
+    if (checked.markupKept && pending.validator) {
+        checked.reason = pending.validator->check(pending.source, checked.translation);
+    }
+    return checked;
+}
+
+// Context tokens taken by one item: JSON wrapping of input and output, text and expected translation
+int itemCost(int textTokens)
+{
+    return 2 * kItemOverheadTokens + textTokens + int(textTokens * kOutputExpansion);
+}
+
+// Length class of a source text for batching: up to 8 tokens, then one class per doubling
+int lengthClass(int tokens)
+{
+    int cls = 0;
+    for (int limit = 8; tokens > limit && cls < 12; limit *= 2) {
+        cls++;
+    }
+    return cls;
+}
+
+// Errors worth retrying: the server is restarting, overloaded or briefly unreachable
+bool isTransientError(QNetworkReply *reply)
+{
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 408 || status == 429 || status == 500 || status == 502 || status == 503 || status == 504) {
+        return true;
+    }
+    switch (reply->error()) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::UnknownNetworkError:
+    case QNetworkReply::ProxyConnectionClosedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::ServiceUnavailableError:
+        return true;
+    default:
+        return false;
+    }
+}
+}
+
+// Per-reply state of a streamed batch
+struct TranslatorEngine::StreamState {
+    QByteArray lineBuffer;          // Incomplete NDJSON line
+    TranslationStreamParser parser; // Model output -> result objects
+    QSet<int> received;             // Items applied so far
+    bool escalated = false;         // Batch of the escalation model
+    QJsonObject finalChunk;         // Chunk with "done": true
+    QString error;
+};
+
+// Timing of one batch request, for the metrics
+struct TranslatorEngine::RequestTiming {
+    QElapsedTimer timer;        // Started when the request is posted
+    qint64 firstByteMs = -1;    // Time to the first response byte
+    int endpoint = 0;           // Index in m_endpoints
+    int promptTokens = 0;       // Estimated size of the whole prompt
+};
 
 TranslatorEngine::TranslatorEngine(QObject *parent)
-    : QObject(parent), m_currentIndex(0), m_isRunning(false), m_networkManager(new QNetworkAccessManager(this))
+    : QObject(parent), m_projectMode(false), m_nextJob(0), m_processedCount(0), m_maxConcurrency(4), m_contextSize(8192), m_maxBatchItems(200), m_maxRetries(5), m_streaming(false),
+      m_prefixCache(false), m_keepAlive("30m"), m_logLevel(LogInfo), m_isRunning(false), m_probeTimer(this), m_networkManager(new QNetworkAccessManager(this)), m_memoryEnabled(true), m_journalEnabled(true), m_snapshotEnabled(true),
+      m_autosaveBatches(10), m_autosaveIntervalMs(60000), m_fuzzyEnabled(true), m_useFuzzyIndex(false),
+      m_dedupeMode(DedupeGlobal)
 {
     // Note: We handle replies individually using lambda or direct connection in sendRequest if needed,
     // but here we might connect globally if we track the active reply.
     // For simplicity, we'll use lambda in sendRequest.
+    // Queued across threads when the engine runs on a worker thread (see MainWindow)
+    qRegisterMetaType<TranslatorEngine::LogLevel>("TranslatorEngine::LogLevel");
+    m_probeTimer.setSingleShot(true);
+    connect(&m_probeTimer, &QTimer::timeout, this, &TranslatorEngine::probeEndpoints);
 }
 
 bool TranslatorEngine::loadFile(const QString &filePath)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        emit errorOccurred("Failed to open file: " + filePath);
+    TsDocument document;
+    QString errorMsg;
+    if (!document.load(filePath, &errorMsg)) {
+        emit errorOccurred(errorMsg);
+        return false;
+    }
+    m_documents = QVector<TsDocument>(1, document);
+    m_projectMode = false;
+    // Until startTranslation() sets the languages there is one job without a language
+    m_jobs.clear();
+    m_jobs.append(TranslationJob());
+
+    indexFinishedTranslations();
+    
+    // Default: load only unfinished
+    prepareItems(false);
+    return true;
+}
+
+bool TranslatorEngine::loadProject(const QString &dirPath)
+{
+    QStringList files;
+    QDirIterator it(dirPath, QStringList("*.ts"), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        files.append(it.next());
+    }
+    files.sort();
+    if (files.isEmpty()) {
+        emit errorOccurred(QString("No .ts files found in %1.").arg(dirPath));
+        return false;
+    }
+    
+    // Files are independent, so they are parsed on the global thread pool
+    const QList<ParsedFile> parsed = QtConcurrent::blockingMapped<QList<ParsedFile>>(files, parseFile);
+    
+    m_documents.clear();
+    m_jobs.clear();
+    for (const ParsedFile &file : parsed) {
+        if (!file.error.isEmpty()) {
+            emit logMessage(QString("Warning: Skipping %1: %2").arg(file.path, file.error), LogWarning);
+            continue;
+        }
+        if (file.document.language().isEmpty()) {
+            emit logMessage(QString("Warning: Skipping %1: no <TS language> attribute.").arg(file.path), LogWarning);
+            continue;
+        }
+        TranslationJob job;
+        job.document = m_documents.size();
+        job.targetLang = file.document.language();
+        m_jobs.append(job);
+        m_documents.append(file.document);
+    }
+    if (m_documents.isEmpty()) {
+        emit errorOccurred(QString("No usable .ts files in %1.").arg(dirPath));
         return false;
     }
+    m_projectMode = true;
+    emit logMessage(QString("Loaded %1 of %2 .ts files from %3.").arg(m_documents.size()).arg(files.size()).arg(dirPath));
+    
+    indexFinishedTranslations();
+    prepareItems(false);
+    return true;
+}
+
+bool TranslatorEngine::saveProject()
+{
+    bool ok = true;
+    for (TranslationJob &job : m_jobs) {
+        if (!saveJob(job, m_documents[job.document].filePath())) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool TranslatorEngine::isProjectMode() const
+{
+    return m_projectMode;
+}
+
+void TranslatorEngine::indexFinishedTranslations()
+{
+    // Finished translations of each file, reused for near-identical sources and as
+    // few-shot examples. A translation the snapshot saved for another source of the
+    // same context is stale: that source was edited after translating.
+    m_fuzzyIndexes = QVector<FuzzyIndex>(m_documents.size());
+    int indexed = 0;
+    for (int d = 0; d < m_documents.size(); ++d) {
+        FuzzyIndex &index = m_fuzzyIndexes[d];
+        m_documents[d].scan([&](const TsDocument::Message &message) {
+            if (message.type == "unfinished" || message.translation.isEmpty()) return true;
+            for (const TranslationJob &job : m_jobs) {
+                if (job.document == d && job.snapshot.isStale(message.context, message.source, message.translation)) {
+                    return true;
+                }
+            }
+            index.add(message.source, message.translation);
+            return true;
+        });
+        indexed += index.size();
+    }
+    if (indexed > 0) {
+        emit logMessage(QString("Indexed %1 finished translations for reuse.").arg(indexed), LogDebug);
+    }
+}
+
+void TranslatorEngine::prepareItems(bool retranslateAll)
+{
+    m_itemsToTranslate.clear();
+    if (m_jobs.isEmpty()) {
+        m_jobs.append(TranslationJob());
+    }
+    
+    QVector<QVector<int>> jobsOfDocument(m_documents.size());
+    for (int job = 0; job < m_jobs.size(); ++job) {
+        if (m_jobs[job].document < m_documents.size()) {
+            jobsOfDocument[m_jobs[job].document].append(job);
+        }
+    }
+    
+    // Interning tables per target language: dedupe key -> index in m_itemsToTranslate.
+    // Shared by all files of a project, so a common string is translated once; there the
+    // key is always (context, comment, source), as lupdate would tell the messages apart.
+    QHash<QString, QHash<QString, int>> internedSources;
+    const bool perContext = m_dedupeMode == DedupePerContext || m_projectMode;
+    int messageCount = 0;
+    int restoredCount = 0;
+    int changedCount = 0;
+    
+    // Stream over every document once and fan each message out to its target languages
+    for (int d = 0; d < m_documents.size(); ++d) {
+        m_documents[d].scan([&](const TsDocument::Message &message) {
+            for (int job : jobsOfDocument[d]) {
+                // Messages already translated in this session count as finished
+                QHash<int, QString> &translations = m_jobs[job].translations;
+                auto patched = translations.constFind(message.offset);
+                const bool translatedNow = patched != translations.constEnd() && !patched.value().isEmpty();
+                bool finished = patched != translations.constEnd()
+                        ? translatedNow
+                        : message.type != "unfinished" && !message.translation.isEmpty();
+                
+                // With a snapshot of the last save, unchanged sources keep (or get back) their
+                // translation. A finished message is only sent again if its translation was
+                // saved for a different source; one the snapshot does not know (translated
+                // by hand since) stays as it is.
+                const TranslationSnapshot &snapshot = m_jobs[job].snapshot;
+                if (!retranslateAll && !translatedNow && !snapshot.isEmpty()) {
+                    QString previous;
+                    if (snapshot.lookup(TranslationSnapshot::makeKey(message.context, message.source), &previous)) {
+                        if (!finished) {
+                            translations.insert(message.offset, previous);
+                            restoredCount++;
+                        }
+                        continue;
+                    }
+                    if (finished && snapshot.isStale(message.context, message.source, message.translation)) {
+                        changedCount++;
+                        finished = false;
+                    }
+                }
+                
+                // If retranslateAll is true, add all items.
+                // Otherwise, only add unfinished or empty items.
+                if (!retranslateAll && finished) {
+                    continue;
+                }
+                messageCount++;
+                
+                QHash<QString, int> &interned = internedSources[m_jobs[job].targetLang];
+                QString key = perContext ? message.context + QChar(0x1f) + message.comment + QChar(0x1f) + message.source
+                                         : message.source;
+                auto it = m_dedupeMode != DedupeOff ? interned.constFind(key) : interned.constEnd();
+                
+                if (it != interned.constEnd()) {
+                    // Same source already queued: share its batch slot
+                    m_itemsToTranslate[it.value()].duplicates.append(qMakePair(job, message.offset));
+                } else {
+                    if (m_dedupeMode != DedupeOff) {
+                        interned.insert(key, m_itemsToTranslate.size());
+                    }
+                    TranslationItem item;
+                    item.context = message.context;
+                    item.source = message.source;
+                    item.job = job;
+                    item.offset = message.offset;
+                    m_itemsToTranslate.append(item);
+                }
+            }
+            return true;
+        });
+    }
+    
+    if (restoredCount > 0 || changedCount > 0) {
+        emit logMessage(QString("Snapshot of the last save: %1 unchanged messages restored, %2 finished messages with an edited source scheduled again.")
+                        .arg(restoredCount).arg(changedCount));
+    }
+    emit logMessage(QString("Prepared %1 items to translate (Retranslate All: %2).").arg(m_itemsToTranslate.size()).arg(retranslateAll ? "Yes" : "No"));
+    if (messageCount > m_itemsToTranslate.size()) {
+        emit logMessage(QString("Merged %1 messages with identical source text into %2 unique items.")
+                        .arg(messageCount).arg(m_itemsToTranslate.size()));
+    }
+}
+
+bool TranslatorEngine::saveFile(const QString &filePath, const QString &targetLang)
+{
+    for (TranslationJob &job : m_jobs) {
+        if (targetLang.isEmpty() || job.targetLang == targetLang) {
+            return saveJob(job, filePath);
+        }
+    }
+    emit errorOccurred(QString("No translation for language %1 to save.").arg(targetLang));
+    return false;
+}
 
+bool TranslatorEngine::saveJob(TranslationJob &job, const QString &filePath)
+{
+    // Copies the original text through and patches only the translated elements
     QString errorMsg;
-    int errorLine, errorColumn;
-    if (!m_doc.setContent(&file, &errorMsg, &errorLine, &errorColumn)) {
-        emit errorOccurred(QString("XML Parse error: %1 at line %2 col %3").arg(errorMsg).arg(errorLine).arg(errorColumn));
-        file.close();
+    if (!m_documents[job.document].save(filePath, job.translations, &errorMsg)) {
+        emit errorOccurred(errorMsg);
         return false;
     }
-    file.close();
+    emit logMessage("File saved successfully.");
+    job.unsavedBatches = 0;
+    writeSnapshot(job);
+    
+    // The saved file now holds everything the journal (and the autosave copy) recorded
+    if (!m_isRunning && job.journal) {
+        job.journal->remove();
+        job.journal.reset();
+    }
+    if (!m_isRunning && !job.autosavePath.isEmpty()
+        && QFileInfo(job.autosavePath).absoluteFilePath() != QFileInfo(filePath).absoluteFilePath()) {
+        QFile::remove(job.autosavePath);
+        job.autosavePath.clear();
+    }
+    return true;
+}
 
-    // Default: load only unfinished
-    prepareItems(false);
+int TranslatorEngine::getUnfinishedCount() const
+{
+    return m_itemsToTranslate.size();
+}
+
+void TranslatorEngine::startTranslation(const QString &targetLang, const QString &apiUrl, const QString &modelName, bool retranslateAll)
+{
+    startTranslation(QStringList(targetLang), apiUrl, modelName, retranslateAll);
+}
+
+void TranslatorEngine::startTranslation(const QStringList &targetLangs, const QString &apiUrl, const QString &modelName, bool retranslateAll)
+{
+    QString poolError;
+    if (!m_endpoints.parse(apiUrl, modelName, m_maxConcurrency, &poolError)) {
+        emit errorOccurred(poolError);
+        emit translationFinished();
+        return;
+    }
+    m_modelName = modelName;
+    
+    // One job per language of each document (a project file only has its own language);
+    // results of an earlier run in this session are kept
+    QVector<TranslationJob> jobs;
+    for (int d = 0; d < m_documents.size(); ++d) {
+        QStringList langs = targetLangs;
+        if (m_projectMode) {
+            const QString language = m_documents[d].language();
+            langs = targetLangs.isEmpty() || targetLangs.contains(language, Qt::CaseInsensitive) ? QStringList(language) : QStringList();
+        }
+        for (const QString &lang : langs) {
+            TranslationJob job;
+            job.document = d;
+            job.targetLang = lang;
+            job.validator = TranslationValidator(lang, m_documents[d].sourceLanguage());
+            if (!m_autosavePattern.isEmpty()) {
+                job.autosavePath = outputPath(m_autosavePattern, m_documents[d].filePath(), lang);
+                job.lastAutosave.start();
+            }
+            for (const TranslationJob &previous : m_jobs) {
+                if (previous.document == d && previous.targetLang == lang) {
+                    job.translations = previous.translations;
+                }
+            }
+            jobs.append(job);
+        }
+    }
+    m_jobs = jobs;
+    m_nextJob = 0;
+    
+    m_stats = TranslationStats();
+    m_metrics.reset();
+    m_metrics.setPromptCaching(m_prefixCache);
+    m_itemAttempts.clear();
+    m_batchRetries.clear();
+    m_escalatedItems.clear();
+    m_runTimer.start();
+    
+    // Re-prepare items based on the flag right before starting
+    if (loadSnapshots()) {
+        indexFinishedTranslations();
+    }
+    prepareItems(retranslateAll);
+    
+    // Resume an interrupted run of the same file, language and model
+    replayJournals();
+    
+    // Retranslate All asks for fresh model output, so the memory is only written in that case
+    m_useFuzzyIndex = false;
+    if (m_fuzzyEnabled && !retranslateAll) {
+        for (const FuzzyIndex &index : m_fuzzyIndexes) {
+            m_useFuzzyIndex = m_useFuzzyIndex || index.size() > 0;
+        }
+    }
+    if (!retranslateAll) {
+        resolveFromMemory();
+        resolveFromIndex();
+    } else {
+        openMemory();
+    }
+
+    if (m_itemsToTranslate.isEmpty()) {
+        emit logMessage("Nothing to translate.");
+        finishRun();
+        return;
+    }
+    
+    m_processedCount = 0;
+    m_isRunning = true;
+    
+    // 按 token 预算分批，避免请求过大导致模型上下文溢出或响应截断，同时让短文本批次尽量装满
+    buildBatches();
+    int batchCount = 0;
+    for (const TranslationJob &job : m_jobs) {
+        batchCount += job.pendingBatches.size();
+    }
+    QStringList languages = targetLanguages();
+    languages.removeDuplicates();
+    if (m_projectMode) {
+        emit logMessage(QString("Project: %1 files in %2 languages.").arg(m_jobs.size()).arg(languages.size()));
+    }
+    emit logMessage(QString("Starting translation into %1: %2 items total in %3 batches (context %4 tokens), up to %5 concurrent requests on %6 endpoint(s)...")
+                    .arg(languages.join(", ")).arg(m_itemsToTranslate.size()).arg(batchCount).arg(m_contextSize)
+                    .arg(m_endpoints.freeSlots()).arg(m_endpoints.size()));
+    if (!m_escalationModel.isEmpty()) {
+        emit logMessage(QString("Suspect results of %1 are translated again by %2.").arg(m_modelName, m_escalationModel));
+    }
+    emit progressUpdated(0, m_itemsToTranslate.size());
+    
+    dispatchBatches();
+}
+
+const TranslationStats &TranslatorEngine::runStats() const
+{
+    return m_stats;
+}
+
+const MetricsCollector &TranslatorEngine::metrics() const
+{
+    return m_metrics;
+}
+
+QStringList TranslatorEngine::targetLanguages() const
+{
+    QStringList langs;
+    for (const TranslationJob &job : m_jobs) {
+        langs.append(job.targetLang);
+    }
+    return langs;
+}
+
+void TranslatorEngine::warmUp(const QString &apiUrl, const QString &modelName)
+{
+    EndpointPool servers;
+    if (!servers.parse(apiUrl, modelName, 1)) return;
+    
+    for (int i = 0; i < servers.size(); ++i) {
+        const QString url = servers.endpoint(i).url;
+        QStringList models(servers.endpoint(i).model);
+        if (!m_escalationModel.isEmpty() && m_escalationModel != models.first()) {
+            models.append(m_escalationModel);
+        }
+        for (const QString &model : models) {
+            if (model.isEmpty()) continue;
+            
+            // Ollama loads the model for a generate request without a prompt and answers
+            // with done_reason "load" and no tokens
+            QJsonObject json;
+            json["model"] = model;
+            json["keep_alive"] = m_keepAlive;
+            QNetworkRequest request(QUrl(EndpointPool::siblingUrl(url, "generate")));
+            request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+            QElapsedTimer timer;
+            timer.start();
+            QNetworkReply *reply = m_networkManager->post(request, QJsonDocument(json).toJson(QJsonDocument::Compact));
+            connect(reply, &QNetworkReply::finished, this, [this, reply, url, model, timer]() {
+                reply->deleteLater();
+                const QJsonObject obj = QJsonDocument::fromJson(reply->readAll()).object();
+                if (reply->error() != QNetworkReply::NoError || obj.contains("error")) {
+                    const QString reason = obj.contains("error") ? obj.value("error").toString() : reply->errorString();
+                    emit logMessage(QString("Warm-up of %1 on %2 failed: %3").arg(model, url, reason), LogDebug);
+                    return;
+                }
+                emit logMessage(QString("Model %1 ready on %2 (load %3 s of %4 s).").arg(model, url)
+                                .arg(obj.value("load_duration").toDouble() / 1e9, 0, 'f', 1)
+                                .arg(timer.elapsed() / 1000.0, 0, 'f', 1));
+            });
+        }
+    }
+}
+
+void TranslatorEngine::stopTranslation()
+{
+    if (!m_isRunning) return;
+    emit logMessage("Translation stopped by user.", LogWarning);
+    // Results applied so far are kept (and journaled), so the run can be saved or resumed
+    finishRun();
+}
+
+void TranslatorEngine::setMaxConcurrency(int count)
+{
+    m_maxConcurrency = qMax(1, count);
+}
+
+int TranslatorEngine::maxConcurrency() const
+{
+    return m_maxConcurrency;
+}
+
+void TranslatorEngine::setContextSize(int tokens)
+{
+    m_contextSize = qMax(512, tokens);
+}
+
+int TranslatorEngine::contextSize() const
+{
+    return m_contextSize;
+}
+
+void TranslatorEngine::setMaxBatchItems(int count)
+{
+    m_maxBatchItems = qMax(1, count);
+}
+
+int TranslatorEngine::maxBatchItems() const
+{
+    return m_maxBatchItems;
+}
+
+void TranslatorEngine::setMaxRetries(int count)
+{
+    m_maxRetries = qMax(0, count);
+}
+
+int TranslatorEngine::maxRetries() const
+{
+    return m_maxRetries;
+}
+
+void TranslatorEngine::setAutosave(const QString &pathPattern, int everyBatches, int intervalSeconds)
+{
+    m_autosavePattern = pathPattern;
+    m_autosaveBatches = qMax(1, everyBatches);
+    m_autosaveIntervalMs = qMax(1, intervalSeconds) * 1000;
+}
+
+QString TranslatorEngine::autosavePattern() const
+{
+    return m_autosavePattern;
+}
+
+QString TranslatorEngine::outputPath(const QString &pattern, const QString &input, const QString &lang)
+{
+    QFileInfo info(input);
+    QString langTag = lang;
+    langTag.replace(' ', '_');
+    QString path = pattern;
+    path.replace("{dir}", info.path());
+    path.replace("{name}", info.completeBaseName());
+    path.replace("{lang}", langTag);
+    return path;
+}
+
+void TranslatorEngine::setEscalationModel(const QString &model)
+{
+    m_escalationModel = model.trimmed();
+}
+
+QString TranslatorEngine::escalationModel() const
+{
+    return m_escalationModel;
+}
+
+void TranslatorEngine::setFuzzyMatchingEnabled(bool enabled)
+{
+    m_fuzzyEnabled = enabled;
+}
+
+bool TranslatorEngine::isFuzzyMatchingEnabled() const
+{
+    return m_fuzzyEnabled;
+}
+
+void TranslatorEngine::setLogLevel(LogLevel level)
+{
+    m_logLevel = level;
+}
+
+TranslatorEngine::LogLevel TranslatorEngine::logLevel() const
+{
+    return m_logLevel;
+}
+
+void TranslatorEngine::setPrefixCacheEnabled(bool enabled)
+{
+    m_prefixCache = enabled;
+}
+
+bool TranslatorEngine::isPrefixCacheEnabled() const
+{
+    return m_prefixCache;
+}
+
+void TranslatorEngine::setKeepAlive(const QString &duration)
+{
+    m_keepAlive = duration;
+}
+
+QString TranslatorEngine::keepAlive() const
+{
+    return m_keepAlive;
+}
+
+void TranslatorEngine::setStreamingEnabled(bool enabled)
+{
+    m_streaming = enabled;
+}
+
+bool TranslatorEngine::isStreamingEnabled() const
+{
+    return m_streaming;
+}
+
+int TranslatorEngine::estimateTokens(const QString &text)
+{
+    // Typical BPE vocabularies: ~4 Latin characters per token, ~2 for other alphabets,
+    // about one token per CJK / Kana / Hangul character. Counted in quarter tokens.
+    int quarters = 0;
+    for (QChar ch : text) {
+        ushort u = ch.unicode();
+        quarters += u < 0x80 ? 1 : (u < 0x2E80 ? 2 : 4);
+    }
+    return (quarters + 3) / 4;
+}
+
+void TranslatorEngine::buildBatches()
+{
+    // Batches never mix languages, so every job is packed separately
+    QVector<QVector<int>> batches(m_jobs.size());
+    QVector<int> batchTokens(m_jobs.size(), 0);
+    QVector<int> budgets(m_jobs.size());
+    for (int job = 0; job < m_jobs.size(); ++job) {
+        m_jobs[job].pendingBatches.clear();
+        budgets[job] = tokenBudget(job);
+    }
+    
+    // Batches hold items of one length class, so a long help text neither holds up nor
+    // truncates a batch of one-word labels; within a class, items of the same <context>
+    // stay together (in document order) for more coherent prompts. Longer classes are
+    // queued first so that the end of the run is made of short, cheap batches.
+    const int count = m_itemsToTranslate.size();
+    QVector<int> order(count);
+    QVector<int> tokens(count);
+    QVector<int> classes(count);
+    QVector<int> contextRanks(count);
+    QHash<QString, int> firstContext;
+    for (int i = 0; i < count; ++i) {
+        const TranslationItem &item = m_itemsToTranslate[i];
+        order[i] = i;
+        tokens[i] = estimateTokens(MarkupMasker::mask(item.source).text);
+        classes[i] = lengthClass(tokens[i]);
+        if (!firstContext.contains(item.context)) {
+            firstContext.insert(item.context, i);
+        }
+        contextRanks[i] = firstContext.value(item.context);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        if (classes[a] != classes[b]) return classes[a] > classes[b];
+        return contextRanks[a] < contextRanks[b];
+    });
+    
+    QVector<int> batchClass(m_jobs.size(), -1);
+    for (int i : order) {
+        const int job = m_itemsToTranslate[i].job;
+        const int cost = itemCost(tokens[i]);
+        QVector<int> &batch = batches[job];
+        
+        if (!batch.isEmpty() && (batchTokens[job] + cost > budgets[job] || batch.size() >= m_maxBatchItems
+                                 || classes[i] != batchClass[job])) {
+            m_jobs[job].pendingBatches.append(batch);
+            batch.clear();
+            batchTokens[job] = 0;
+        }
+        // An item larger than the budget still gets a batch of its own
+        batch.append(i);
+        batchTokens[job] += cost;
+        batchClass[job] = classes[i];
+    }
+    for (int job = 0; job < m_jobs.size(); ++job) {
+        if (!batches[job].isEmpty()) {
+            m_jobs[job].pendingBatches.append(batches[job]);
+        }
+    }
+}
+
+int TranslatorEngine::tokenBudget(int job) const
+{
+    // Fixed part of every request: instructions plus the JSON wrapper of the answer
+    const QString emptyPrompt = m_prefixCache ? systemPrompt() + buildUserMessage("[]", 0, m_jobs[job].targetLang, QString())
+                                              : buildPrompt("[]", 0, m_jobs[job].targetLang, QString());
+    const int promptOverhead = estimateTokens(emptyPrompt) + kItemOverheadTokens
+                               + (m_useFuzzyIndex ? kFewShotReserveTokens : 0);
+    return qMax(1, int(m_contextSize * (1.0 - kContextSafetyMargin)) - promptOverhead);
+}
+
+void TranslatorEngine::queueEscalations()
+{
+    const int maxItems = qMin(kEscalationBatchItems, m_maxBatchItems);
+    for (int j = 0; j < m_jobs.size(); ++j) {
+        TranslationJob &job = m_jobs[j];
+        // Collect full batches while first-pass batches of the job are still queued
+        if (job.escalations.isEmpty() || (!job.pendingBatches.isEmpty() && job.escalations.size() < maxItems)) {
+            continue;
+        }
+        const int budget = tokenBudget(j);
+        QVector<int> batch;
+        int batchTokens = 0;
+        for (int i : job.escalations) {
+            const int cost = itemCost(estimateTokens(MarkupMasker::mask(m_itemsToTranslate[i].source).text));
+            if (!batch.isEmpty() && (batchTokens + cost > budget || batch.size() >= maxItems)) {
+                job.pendingBatches.append(batch);
+                batch.clear();
+                batchTokens = 0;
+            }
+            batch.append(i);
+            batchTokens += cost;
+        }
+        job.pendingBatches.append(batch);
+        job.escalations.clear();
+    }
+}
+
+void TranslatorEngine::splitBatch(const QVector<int> &items, const QString &reason)
+{
+    const int half = items.size() / 2;
+    emit logMessage(QString("%1: splitting batch of %2 items into %3 + %4 and retrying...")
+                    .arg(reason).arg(items.size()).arg(half).arg(items.size() - half), LogWarning);
+    m_stats.failedBatches++;
+    // The halves are new batches with retries of their own
+    m_batchRetries.remove(items);
+    
+    // Retry the halves before any new batch
+    QList<QVector<int>> &queue = jobOf(items).pendingBatches;
+    queue.prepend(items.mid(half));
+    queue.prepend(items.mid(0, half));
+    finishBatch(0);
+}
+
+void TranslatorEngine::setTranslationMemoryEnabled(bool enabled)
+{
+    m_memoryEnabled = enabled;
+    if (!enabled) {
+        m_memory.close();
+    }
+}
+
+bool TranslatorEngine::isTranslationMemoryEnabled() const
+{
+    return m_memoryEnabled;
+}
+
+void TranslatorEngine::setJournalEnabled(bool enabled)
+{
+    m_journalEnabled = enabled;
+}
+
+bool TranslatorEngine::isJournalEnabled() const
+{
+    return m_journalEnabled;
+}
+
+void TranslatorEngine::setSnapshotEnabled(bool enabled)
+{
+    m_snapshotEnabled = enabled;
+}
+
+bool TranslatorEngine::isSnapshotEnabled() const
+{
+    return m_snapshotEnabled;
+}
+
+void TranslatorEngine::setTranslationMemoryPath(const QString &path)
+{
+    if (path != m_memoryPath) {
+        m_memoryPath = path;
+        m_memory.close();
+    }
+}
+
+bool TranslatorEngine::openMemory()
+{
+    if (!m_memoryEnabled) return false;
+    if (m_memory.isOpen()) return true;
+    
+    QString path = m_memoryPath.isEmpty() ? TranslationMemory::defaultPath() : m_memoryPath;
+    QString error;
+    if (!m_memory.open(path, &error)) {
+        emit logMessage(QString("Warning: Translation memory unavailable (%1): %2").arg(path, error), LogWarning);
+        return false;
+    }
+    emit logMessage(QString("Translation memory loaded: %1 entries from %2").arg(m_memory.size()).arg(path));
     return true;
 }
 
-void TranslatorEngine::prepareItems(bool retranslateAll)
+void TranslatorEngine::resolveFromMemory()
+{
+    if (!openMemory()) return;
+    
+    int hits = resolveItems([this](const TranslationItem &item, QString *translation) {
+        return m_memory.lookup(TranslationMemory::makeKey(item.source, item.context, m_jobs[item.job].targetLang, m_modelName), translation);
+    });
+    
+    if (hits > 0) {
+        emit logMessage(QString("Translation memory: %1 items resolved locally, %2 left for the model.").arg(hits).arg(m_itemsToTranslate.size()));
+    }
+}
+
+void TranslatorEngine::resolveFromIndex()
+{
+    if (!m_useFuzzyIndex) return;
+    
+    int hits = resolveItems([this](const TranslationItem &item, QString *translation) {
+        return m_fuzzyIndexes[m_jobs[item.job].document].exactVariant(item.source, translation);
+    });
+    
+    if (hits > 0) {
+        emit logMessage(QString("Reused %1 existing translations of near-identical sources, %2 left for the model.")
+                        .arg(hits).arg(m_itemsToTranslate.size()));
+    }
+}
+
+void TranslatorEngine::replayJournals()
+{
+    if (!m_journalEnabled) return;
+    
+    for (TranslationJob &job : m_jobs) {
+        const QString filePath = m_documents[job.document].filePath();
+        if (filePath.isEmpty()) continue;
+        QString path = TranslationMemory::journalPath(filePath, job.targetLang, m_modelName);
+        job.journal.reset(new TranslationMemory);
+        QString error;
+        if (!job.journal->open(path, &error)) {
+            emit logMessage(QString("Warning: Checkpoint journal unavailable (%1): %2").arg(path, error), LogWarning);
+            job.journal.reset();
+        }
+    }
+    
+    int hits = resolveItems([this](const TranslationItem &item, QString *translation) {
+        const TranslationJob &job = m_jobs[item.job];
+        return job.journal && job.journal->lookup(TranslationMemory::makeKey(item.source, item.context, job.targetLang, m_modelName), translation);
+    });
+    
+    if (hits > 0) {
+        emit logMessage(QString("Resumed %1 items from the checkpoint journal of an earlier run.").arg(hits));
+    }
+}
+
+bool TranslatorEngine::loadSnapshots()
+{
+    if (!m_snapshotEnabled) return false;
+    
+    bool loaded = false;
+    for (TranslationJob &job : m_jobs) {
+        const QString filePath = m_documents[job.document].filePath();
+        if (filePath.isEmpty()) continue;
+        QString path = TranslationSnapshot::snapshotPath(filePath, job.targetLang);
+        QString error;
+        if (!job.snapshot.load(path, &error)) {
+            emit logMessage(QString("Warning: Snapshot of the last save unavailable (%1): %2").arg(path, error), LogWarning);
+        } else if (!job.snapshot.isEmpty()) {
+            emit logMessage(QString("Loaded the snapshot of the last %1 save: %2 messages.").arg(job.targetLang).arg(job.snapshot.size()), LogDebug);
+            loaded = true;
+        }
+    }
+    return loaded;
+}
+
+void TranslatorEngine::writeSnapshot(TranslationJob &job)
+{
+    const TsDocument &document = m_documents[job.document];
+    if (!m_snapshotEnabled || document.filePath().isEmpty() || job.targetLang.isEmpty()) return;
+    
+    job.snapshot.clear();
+    document.scan([&job](const TsDocument::Message &message) {
+        auto patched = job.translations.constFind(message.offset);
+        const QString translation = patched != job.translations.constEnd() ? patched.value()
+                                    : message.type != "unfinished" ? message.translation : QString();
+        if (!translation.isEmpty()) {
+            job.snapshot.insert(message.context, message.source, translation);
+        }
+        return true;
+    });
+    
+    QString path = TranslationSnapshot::snapshotPath(document.filePath(), job.targetLang);
+    QString error;
+    if (!job.snapshot.save(path, &error)) {
+        emit logMessage(QString("Warning: Snapshot not written (%1): %2").arg(path, error), LogWarning);
+    }
+}
+
+int TranslatorEngine::resolveItems(const std::function<bool(const TranslationItem &, QString *)> &lookup)
+{
+    int hits = 0;
+    QList<TranslationItem> misses;
+    misses.reserve(m_itemsToTranslate.size());
+    for (TranslationItem &item : m_itemsToTranslate) {
+        QString translation;
+        if (lookup(item, &translation)) {
+            applyTranslation(item, translation);
+            hits++;
+        } else {
+            misses.append(item);
+        }
+    }
+    m_itemsToTranslate = misses;
+    m_stats.itemsResolved += hits;
+    return hits;
+}
+
+void TranslatorEngine::checkpoint(TranslationJob &job)
+{
+    // Parsing and applying the answer is done; the flush, fsync and autosave below are
+    // disk I/O and must not count as parse time
+    endParseTiming();
+    m_memory.flush();
+    if (job.journal) {
+        job.journal->sync();
+    }
+    
+    job.unsavedBatches++;
+    if (job.unsavedBatches >= m_autosaveBatches || job.lastAutosave.hasExpired(m_autosaveIntervalMs)) {
+        autosave(job);
+    }
+}
+
+void TranslatorEngine::autosave(TranslationJob &job)
+{
+    if (job.autosavePath.isEmpty() || job.unsavedBatches == 0) return;
+    
+    QString errorMsg;
+    if (m_documents[job.document].save(job.autosavePath, job.translations, &errorMsg)) {
+        emit logMessage(QString("Autosaved %1 translations to %2").arg(job.targetLang, job.autosavePath), LogDebug);
+    } else {
+        emit logMessage("Warning: Autosave failed: " + errorMsg, LogWarning);
+    }
+    // A failing target is retried after the next interval, not after every batch
+    job.unsavedBatches = 0;
+    job.lastAutosave.start();
+}
+
+void TranslatorEngine::applyTranslation(TranslationItem &item, const QString &translation)
+{
+    item.translation = translation;
+    
+    // The element content is replaced and its "unfinished" type dropped when saving
+    m_jobs[item.job].translations.insert(item.offset, translation);
+    for (const QPair<int, int> &duplicate : item.duplicates) {
+        TranslationJob &job = m_jobs[duplicate.first];
+        job.translations.insert(duplicate.second, translation);
+        // Project files without batches of their own are still autosaved at the end of the run
+        if (duplicate.first != item.job && job.unsavedBatches == 0) {
+            job.unsavedBatches = 1;
+        }
+    }
+}
+
+void TranslatorEngine::setDedupeMode(DedupeMode mode)
+{
+    m_dedupeMode = mode;
+}
+
+TranslatorEngine::DedupeMode TranslatorEngine::dedupeMode() const
+{
+    return m_dedupeMode;
+}
+
+void TranslatorEngine::abortActiveReplies()
+{
+    // abort() emits finished() synchronously, so work on a copy
+    const QSet<QNetworkReply*> replies = m_activeReplies;
+    m_activeReplies.clear();
+    for (QNetworkReply *reply : replies) {
+        reply->abort();
+    }
+    qDeleteAll(m_retryTimers);
+    m_retryTimers.clear();
+    m_probeTimer.stop();
+}
+
+// 保持最多 m_maxConcurrency 个批次同时在途，批次完成顺序可以与发送顺序不同
+void TranslatorEngine::dispatchBatches()
 {
-    m_itemsToTranslate.clear();
-    
-    QDomElement root = m_doc.documentElement(); // TS
-    QDomNode contextNode = root.firstChild();
+    if (!m_isRunning) return;
+    queueEscalations();
     
-    while (!contextNode.isNull()) {
-        if (contextNode.nodeName() == "context") {
-            QDomElement contextElem = contextNode.toElement();
-            QString contextName;
-            
-            QDomNode n = contextElem.firstChild();
-            while (!n.isNull()) {
-                if (n.nodeName() == "name") {
-                    contextName = n.toElement().text();
-                } else if (n.nodeName() == "message") {
-                    QDomElement messageElem = n.toElement();
-                    QDomElement sourceElem = messageElem.firstChildElement("source");
-                    QDomElement translationElem = messageElem.firstChildElement("translation");
-                    
-                    if (!sourceElem.isNull() && !translationElem.isNull()) {
-                        QString type = translationElem.attribute("type");
-                        QString text = translationElem.text();
-                        
-                        // If retranslateAll is true, add all items.
-                        // Otherwise, only add unfinished or empty items.
-                        if (retranslateAll || type == "unfinished" || text.isEmpty()) {
-                            TranslationItem item;
-                            item.context = contextName;
-                            item.source = sourceElem.text();
-                            item.element = translationElem;
-                            m_itemsToTranslate.append(item);
-                        }
-                    }
-                }
-                n = n.nextSibling();
+    for (;;) {
+        // Round-robin over the languages so that every job keeps the model busy
+        int next = -1;
+        for (int k = 0; k < m_jobs.size(); ++k) {
+            int job = (m_nextJob + k) % m_jobs.size();
+            if (!m_jobs[job].pendingBatches.isEmpty()) {
+                next = job;
+                break;
             }
         }
-        contextNode = contextNode.nextSibling();
+        if (next < 0) break;
+        
+        // Fastest expected endpoint with a free slot
+        int endpoint = m_endpoints.acquire();
+        if (endpoint < 0) break;
+        
+        m_nextJob = (next + 1) % m_jobs.size();
+        processBatch(m_jobs[next].pendingBatches.takeFirst(), endpoint);
     }
     
-    emit logMessage(QString("Prepared %1 items to translate (Retranslate All: %2).").arg(m_itemsToTranslate.size()).arg(retranslateAll ? "Yes" : "No"));
+    if (!m_endpoints.hasUsableEndpoint()) {
+        emit logMessage("No API endpoint is reachable any more.", LogWarning);
+        emit errorOccurred("Network Error: all API endpoints are unavailable.");
+        finishRun();
+        return;
+    }
+    
+    if (m_activeReplies.isEmpty() && m_retryTimers.isEmpty() && !hasPendingBatches()) {
+        emit logMessage("All items processed.");
+        finishRun();
+    }
 }
 
-bool TranslatorEngine::saveFile(const QString &filePath)
+void TranslatorEngine::finishRun()
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        emit errorOccurred("Failed to save file: " + filePath);
-        return false;
+    endParseTiming();
+    m_isRunning = false;
+    abortActiveReplies();
+    m_stats.wallMs = m_runTimer.elapsed();
+    for (TranslationJob &job : m_jobs) {
+        autosave(job);
     }
-    
-    QTextStream out(&file);
-    out.setCodec("UTF-8");
-    m_doc.save(out, 4);
-    file.close();
-    emit logMessage("File saved successfully.");
-    return true;
+    if (!m_escalationModel.isEmpty()) {
+        emit logMessage(QString("Model tiers: %1 items accepted from %2, %3 flagged by validation and sent to %4, "
+                                "%5 of them re-translated.")
+                        .arg(m_stats.itemsTranslated - m_stats.itemsEscalated).arg(m_modelName)
+                        .arg(m_stats.itemsFlagged).arg(m_escalationModel).arg(m_stats.itemsEscalated));
+    }
+    if (m_metrics.batchCount() > 0) {
+        emit logMessage(m_metrics.summaryLine());
+    }
+    emit translationFinished();
 }
 
-int TranslatorEngine::getUnfinishedCount() const
+void TranslatorEngine::endParseTiming()
 {
-    return m_itemsToTranslate.size();
+    if (m_parseTimer.isValid()) {
+        m_stats.parseNs += m_parseTimer.nsecsElapsed();
+        m_parseTimer.invalidate();
+    }
 }
 
-void TranslatorEngine::startTranslation(const QString &targetLang, const QString &apiUrl, const QString &modelName, bool retranslateAll)
+bool TranslatorEngine::hasPendingBatches() const
 {
-    // Re-prepare items based on the flag right before starting
-    prepareItems(retranslateAll);
-
-    if (m_itemsToTranslate.isEmpty()) {
-        emit logMessage("Nothing to translate.");
-        emit translationFinished();
-        return;
+    for (const TranslationJob &job : m_jobs) {
+        if (!job.pendingBatches.isEmpty() || !job.escalations.isEmpty()) return true;
     }
-    
-    m_targetLang = targetLang;
-    m_apiUrl = apiUrl;
-    m_modelName = modelName;
-    m_currentIndex = 0;
-    m_isRunning = true;
-    
-    // 默认使用分批处理，每批 50 条
-    // 这样可以避免一次性请求过大导致模型上下文溢出或响应截断
-    int batchSize = 50;
-    emit logMessage(QString("Starting translation: %1 items total, processing in batches of %2...").arg(m_itemsToTranslate.size()).arg(batchSize));
-    emit progressUpdated(0, m_itemsToTranslate.size());
-    
-    processBatch(0, batchSize);
+    return false;
 }
 
-void TranslatorEngine::stopTranslation()
+TranslationJob &TranslatorEngine::jobOf(const QVector<int> &items)
 {
-    m_isRunning = false;
-    emit logMessage("Translation stopped by user.");
+    return m_jobs[m_itemsToTranslate[items.first()].job];
 }
 
-// 分批处理方法（当一次性请求失败时自动回退使用）
-void TranslatorEngine::processBatch(int startIdx, int batchSize)
+void TranslatorEngine::finishBatch(int count)
 {
-    if (!m_isRunning) return;
+    endParseTiming();
+    m_processedCount += count;
+    emit progressUpdated(m_processedCount, m_itemsToTranslate.size());
+    dispatchBatches();
+}
+
+int TranslatorEngine::requeueItems(const QVector<int> &items, const QString &reason)
+{
+    QVector<int> retry;
+    for (int i : items) {
+        if (++m_itemAttempts[i] <= m_maxRetries) {
+            retry.append(i);
+        }
+    }
     
-    if (startIdx >= m_itemsToTranslate.size()) {
-        emit logMessage("All items processed.");
-        emit translationFinished();
-        m_isRunning = false;
-        return;
+    // Behind the batches already queued, so one bad answer does not stall the job
+    if (!retry.isEmpty()) {
+        emit logMessage(QString("%1: re-queueing %2 items...").arg(reason).arg(retry.size()), LogWarning);
+        jobOf(retry).pendingBatches.append(retry);
+    }
+    const int givenUp = items.size() - retry.size();
+    if (givenUp > 0) {
+        emit logMessage(QString("Giving up on %1 items after %2 attempts.").arg(givenUp).arg(m_maxRetries + 1), LogWarning);
+        m_stats.failedBatches++;
+    }
+    return givenUp;
+}
+
+bool TranslatorEngine::scheduleRetry(const QVector<int> &items, const QString &reason, int failedEndpoint)
+{
+    const int attempt = ++m_batchRetries[items];
+    if (attempt > m_maxRetries) {
+        return false;
+    }
+    
+    // Hand the batch to another server instead of waiting
+    for (int i = 0; i < m_endpoints.size(); ++i) {
+        const EndpointPool::Endpoint &endpoint = m_endpoints.endpoint(i);
+        if (i != failedEndpoint && !endpoint.down && !endpoint.dead) {
+            emit logMessage(QString("%1: handing %2 items to another endpoint (attempt %3 of %4)...")
+                            .arg(reason).arg(items.size()).arg(attempt).arg(m_maxRetries), LogWarning);
+            jobOf(items).pendingBatches.prepend(items);
+            dispatchBatches();
+            return true;
+        }
     }
     
-    int endIndex = qMin(startIdx + batchSize, m_itemsToTranslate.size());
+    const int delay = qMin(kRetryMaxMs, kRetryBaseMs << qMin(attempt - 1, 16));
+    const int jittered = QRandomGenerator::global()->bounded(delay / 2, delay + 1);
+    emit logMessage(QString("%1: retrying %2 items in %3 ms (attempt %4 of %5)...")
+                    .arg(reason).arg(items.size()).arg(jittered).arg(attempt).arg(m_maxRetries), LogWarning);
+    
+    QTimer *timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, this, [this, timer, items]() {
+        m_retryTimers.remove(timer);
+        timer->deleteLater();
+        jobOf(items).pendingBatches.prepend(items);
+        dispatchBatches();
+    });
+    m_retryTimers.insert(timer);
+    timer->start(jittered);
+    
+    // The request slot is free for other batches in the meantime
+    dispatchBatches();
+    return true;
+}
+
+// 构建并发送一个批次（由 dispatchBatches 调度）
+void TranslatorEngine::processBatch(const QVector<int> &items, int endpoint)
+{
     QJsonArray batchArray;
     
-    for (int i = startIdx; i < endIndex; ++i) {
+    // Short batch-local ids (1..n) instead of item indices; markup and placeholders are
+    // masked and restored by applyResults()
+    for (int k = 0; k < items.size(); ++k) {
         QJsonObject itemObj;
-        itemObj["id"] = i;
-        itemObj["text"] = m_itemsToTranslate[i].source;
+        itemObj["id"] = k + 1;
+        itemObj["text"] = MarkupMasker::mask(m_itemsToTranslate[items[k]].source).text;
         batchArray.append(itemObj);
     }
     
-    emit progressUpdated(startIdx, m_itemsToTranslate.size());
-    emit logMessage(QString("Processing batch: items %1-%2 of %3...").arg(startIdx + 1).arg(endIndex).arg(m_itemsToTranslate.size()));
+    // The closest finished translations of the document, as terminology hints
+    QJsonArray examples;
+    if (m_useFuzzyIndex) {
+        const FuzzyIndex &index = m_fuzzyIndexes[jobOf(items).document];
+        QVector<FuzzyIndex::Match> matches;
+        for (int i : items) {
+            matches += index.similar(m_itemsToTranslate[i].source, 1, kFewShotSimilarity);
+        }
+        std::sort(matches.begin(), matches.end(), [](const FuzzyIndex::Match &a, const FuzzyIndex::Match &b) {
+            return a.similarity > b.similarity;
+        });
+        // tokenBudget() only set kFewShotReserveTokens aside, so examples that would
+        // overrun it are left out
+        QSet<QString> used;
+        int exampleTokens = 0;
+        for (const FuzzyIndex::Match &match : matches) {
+            if (examples.size() >= kMaxFewShotExamples) break;
+            if (match.source.size() > kMaxFewShotChars || used.contains(match.source)) continue;
+            const QString text = MarkupMasker::mask(match.source).text;
+            const QString translation = MarkupMasker::mask(match.translation).text;
+            const int tokens = 2 * kItemOverheadTokens + estimateTokens(text) + estimateTokens(translation);
+            if (exampleTokens + tokens > kFewShotReserveTokens) continue;
+            exampleTokens += tokens;
+            used.insert(match.source);
+            QJsonObject example;
+            example["text"] = text;
+            example["translation"] = translation;
+            examples.append(example);
+        }
+    }
+    
+    emit logMessage(QString("Processing batch (%1): %2 items starting at item %3 of %4, %5 examples...")
+                    .arg(jobOf(items).targetLang).arg(items.size()).arg(items.first() + 1).arg(m_itemsToTranslate.size())
+                    .arg(examples.size()), LogDebug);
     
-    sendBatchRequest(batchArray, startIdx, endIndex - startIdx);
+    sendBatchRequest(batchArray, examples, items, endpoint);
+}
+
+QString TranslatorEngine::buildPrompt(const QString &inputJson, int count, const QString &targetLang,
+                                      const QString &examplesJson) const
+{
+    // Prompt 强调 JSON 格式
+    return QString(
+        "Translate ALL %2 items in this JSON array to %1.\n\n"
+        "You MUST return a valid JSON object with this exact structure:\n"
+        "{\"translations\": [{\"id\": 1, \"translation\": \"text1\"}, {\"id\": 2, \"translation\": \"text2\"}, ...]}\n\n"
+        "Tokens like {0}, {1} stand for markup or placeholders: copy each of them exactly once into the translation.\n\n"
+        "%4"
+        "Input: %3\n\n"
+        "Return ONLY the JSON object:"
+    ).arg(targetLang, QString::number(count), inputJson, examplesSection(examplesJson));
+}
+
+QString TranslatorEngine::systemPrompt()
+{
+    // Must stay byte-identical between batches, languages and runs: nothing variable here
+    return QStringLiteral(
+        "You translate the user interface strings of a software application.\n\n"
+        "The user message names the target language and ends with a JSON array of items "
+        "{\"id\": <number>, \"text\": <source text>}. Translate ALL items to the target language.\n\n"
+        "You MUST return a valid JSON object with this exact structure:\n"
+        "{\"translations\": [{\"id\": 1, \"translation\": \"text1\"}, {\"id\": 2, \"translation\": \"text2\"}, ...]}\n\n"
+        "Tokens like {0}, {1} stand for markup or placeholders: copy each of them exactly once into the translation.\n\n"
+        "Keep every id. Return ONLY the JSON object.");
+}
+
+QString TranslatorEngine::buildUserMessage(const QString &inputJson, int count, const QString &targetLang,
+                                           const QString &examplesJson) const
+{
+    // The batch payload comes last so the prefix before it is shared with earlier batches
+    return QString("Target language: %1\nItems: %2\n%4Input: %3")
+        .arg(targetLang, QString::number(count), inputJson, examplesSection(examplesJson));
+}
+
+QString TranslatorEngine::examplesSection(const QString &examplesJson)
+{
+    if (examplesJson.isEmpty()) return QString();
+    return "Existing translations in this project, keep their terminology and style: " + examplesJson + "\n\n";
 }
 
-void TranslatorEngine::sendBatchRequest(const QJsonArray &batchArray, int startIdx, int count)
+void TranslatorEngine::sendBatchRequest(const QJsonArray &batchArray, const QJsonArray &examples, const QVector<int> &items,
+                                        int endpoint)
 {
+    const int count = items.size();
+    const EndpointPool::Endpoint &server = m_endpoints.endpoint(endpoint);
+    
     QNetworkRequest request;
-    request.setUrl(QUrl(m_apiUrl));
+    request.setUrl(QUrl(m_prefixCache ? EndpointPool::siblingUrl(server.url, "chat") : server.url));
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
     
     QJsonObject json;
-    json["model"] = m_modelName;
-    json["stream"] = false;
+    // Batches of flagged items go to the escalation model on the same server
+    const bool escalated = m_escalatedItems.contains(items.first());
+    json["model"] = escalated ? m_escalationModel : server.model;
+    json["stream"] = m_streaming;
     
     // 使用 JSON schema 来强制返回正确的格式
     QJsonObject formatSchema;
@@ -174,8 +1322,8 @@ void TranslatorEngine::sendBatchRequest(const QJsonArray &batchArray, int startI
     QJsonObject properties;
     QJsonObject translationsProp;
     translationsProp["type"] = "array";
-    QJsonObject items;
-    items["type"] = "object";
+    QJsonObject itemSchema;
+    itemSchema["type"] = "object";
     QJsonObject itemProperties;
     QJsonObject idProp;
     idProp["type"] = "integer";
@@ -183,68 +1331,157 @@ void TranslatorEngine::sendBatchRequest(const QJsonArray &batchArray, int startI
     QJsonObject translationProp;
     translationProp["type"] = "string";
     itemProperties["translation"] = translationProp;
-    items["properties"] = itemProperties;
-    items["required"] = QJsonArray::fromStringList({"id", "translation"});
-    translationsProp["items"] = items;
+    itemSchema["properties"] = itemProperties;
+    itemSchema["required"] = QJsonArray::fromStringList({"id", "translation"});
+    translationsProp["items"] = itemSchema;
     properties["translations"] = translationsProp;
     formatSchema["properties"] = properties;
     formatSchema["required"] = QJsonArray::fromStringList({"translations"});
     
     json["format"] = formatSchema; // 使用 JSON schema 而不是简单的 "json"
     
+    // Keeps the model loaded through the run and the idle time until the next one
+    json["keep_alive"] = m_keepAlive;
+    
+    // 上下文长度与分批时使用的 token 预算一致
+    QJsonObject options;
+    options["num_ctx"] = m_contextSize;
+    json["options"] = options;
+    
     QJsonDocument batchDoc(batchArray);
     QString jsonString = batchDoc.toJson(QJsonDocument::Compact);
+    const QString examplesJson = examples.isEmpty() ? QString() : QString(QJsonDocument(examples).toJson(QJsonDocument::Compact));
     
-    // Prompt 强调 JSON 格式
-    QString promptText = QString(
-        "Translate ALL %2 items in this JSON array to %1.\n\n"
-        "You MUST return a valid JSON object with this exact structure:\n"
-        "{\"translations\": [{\"id\": 1, \"translation\": \"text1\"}, {\"id\": 2, \"translation\": \"text2\"}, ...]}\n\n"
-        "Input: %3\n\n"
-        "Return ONLY the JSON object:"
-    ).arg(m_targetLang).arg(count).arg(jsonString);
-    
-    // Ollama API 使用 "prompt" 参数（根据官方文档）
-    json["prompt"] = promptText;
+    QSharedPointer<RequestTiming> timing(new RequestTiming);
+    if (m_prefixCache) {
+        // 固定的 system 消息 + 批次内容放在最后，命中 Ollama 的前缀缓存
+        const QString userMessage = buildUserMessage(jsonString, count, jobOf(items).targetLang, examplesJson);
+        QJsonObject system;
+        system["role"] = "system";
+        system["content"] = systemPrompt();
+        QJsonObject user;
+        user["role"] = "user";
+        user["content"] = userMessage;
+        json["messages"] = QJsonArray{system, user};
+        timing->promptTokens = estimateTokens(systemPrompt()) + estimateTokens(userMessage);
+    } else {
+        // Ollama API 使用 "prompt" 参数（根据官方文档）
+        json["prompt"] = buildPrompt(jsonString, count, jobOf(items).targetLang, examplesJson);
+        timing->promptTokens = estimateTokens(json["prompt"].toString());
+    }
     
     QByteArray data = QJsonDocument(json).toJson();
     
     int requestSizeKB = data.size() / 1024;
-    emit logMessage(QString("Sending batch of %1 items (Request size: ~%2 KB)...").arg(count).arg(requestSizeKB));
+    if (m_endpoints.size() > 1) {
+        emit logMessage(QString("Sending batch of %1 items to %2 (Request size: ~%3 KB)...").arg(count).arg(server.url).arg(requestSizeKB), LogDebug);
+    } else {
+        emit logMessage(QString("Sending batch of %1 items (Request size: ~%2 KB)...").arg(count).arg(requestSizeKB), LogDebug);
+    }
     
     // 如果请求过大（超过 100KB），给出警告
     if (requestSizeKB > 100) {
-        emit logMessage(QString("Warning: Request size is large (%1 KB). This might exceed model context limits.").arg(requestSizeKB));
+        emit logMessage(QString("Warning: Request size is large (%1 KB). This might exceed model context limits.").arg(requestSizeKB), LogWarning);
     }
     
     QNetworkReply *reply = m_networkManager->post(request, data);
+    m_activeReplies.insert(reply);
+    m_stats.requests++;
+    m_stats.bytesSent += data.size();
     
-    connect(reply, &QNetworkReply::finished, this, [this, reply, startIdx, count]() {
+    timing->timer.start();
+    timing->endpoint = endpoint;
+    QSharedPointer<StreamState> stream;
+    if (m_streaming) {
+        stream.reset(new StreamState);
+        stream->escalated = escalated;
+    }
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply, items, stream, timing]() {
+        if (timing->firstByteMs < 0) {
+            timing->firstByteMs = timing->timer.elapsed();
+        }
+        // Non-streamed answers are read in one piece when the reply has finished
+        if (!stream || !m_isRunning) return;
+        QByteArray chunk = reply->readAll();
+        m_stats.bytesReceived += chunk.size();
+        m_parseTimer.start();
+        consumeStream(*stream, chunk, items);
+        endParseTiming();
+    });
+    
+    connect(reply, &QNetworkReply::finished, this, [this, reply, items, count, escalated, stream, timing]() {
         reply->deleteLater();
+        m_activeReplies.remove(reply);
         if (!m_isRunning) return;
+        m_endpoints.release(timing->endpoint);
         
         if (reply->error() != QNetworkReply::NoError) {
-            emit logMessage("Network Error: " + reply->errorString());
+            QVector<int> remaining = items;
+            if (stream && !stream->received.isEmpty()) {
+                emit logMessage(QString("%1 items of the interrupted batch were already applied.").arg(stream->received.size()), LogWarning);
+                checkpoint(jobOf(items));
+                remaining.clear();
+                for (int i : items) {
+                    if (!stream->received.contains(i)) remaining.append(i);
+                }
+                if (remaining.isEmpty()) {
+                    finishBatch(0);
+                    return;
+                }
+            }
+            // With several servers any failure is handled by moving the batch elsewhere
+            const bool pooled = m_endpoints.size() > 1;
+            if (pooled && m_endpoints.reportFailure(timing->endpoint)) {
+                emit logMessage(QString("Endpoint %1 taken out of rotation after repeated errors.")
+                                .arg(m_endpoints.endpoint(timing->endpoint).url), LogWarning);
+                scheduleProbe();
+            }
+            if ((pooled || isTransientError(reply))
+                && scheduleRetry(remaining, "Network Error: " + reply->errorString(), timing->endpoint)) {
+                return;
+            }
+            emit logMessage("Network Error: " + reply->errorString(), LogError);
             emit errorOccurred("Network Error: " + reply->errorString());
-            m_isRunning = false;
-            emit translationFinished();
+            finishRun();
             return;
         }
         
+        m_parseTimer.start();
         QByteArray responseData = reply->readAll();
-        QString rawResponse = QString::fromUtf8(responseData);
-        emit logMessage("Raw API Response: " + rawResponse.left(500) + (rawResponse.length() > 500 ? "..." : ""));
+        m_stats.bytesReceived += responseData.size();
+        
+        if (stream) {
+            consumeStream(*stream, responseData, items);
+            finishStreamedBatch(*stream, *timing, items);
+            return;
+        }
+        
+        if (m_logLevel >= LogDebug) {
+            QString rawResponse = QString::fromUtf8(responseData.left(2048));
+            emit logMessage("Raw API Response: " + rawResponse.left(500) + (rawResponse.length() > 500 ? "..." : ""), LogDebug);
+        }
         
         QJsonDocument jsonDoc = QJsonDocument::fromJson(responseData);
         QJsonObject jsonObj = jsonDoc.object();
+        // /api/chat 的回答位于 message.content
+        if (jsonObj.value("message").isObject() && !jsonObj.contains("response")) {
+            const QJsonObject message = jsonObj.value("message").toObject();
+            jsonObj["response"] = message.value("content");
+            if (message.contains("thinking")) jsonObj["thinking"] = message.value("thinking");
+        }
+        
+        // Ollama 在输出达到上下文长度上限时返回 done_reason = "length"
+        bool truncated = jsonObj.value("done_reason").toString() == "length";
+        if (truncated) {
+            emit logMessage("Warning: Model output was truncated (done_reason: length).", LogWarning);
+        }
         
         // 检查是否有错误信息
         if (jsonObj.contains("error")) {
             QString errorMsg = jsonObj["error"].toString();
-            emit logMessage("API Error: " + errorMsg);
+            emit logMessage("API Error: " + errorMsg, LogError);
             emit errorOccurred("API Error: " + errorMsg);
-            m_isRunning = false;
-            emit translationFinished();
+            finishRun();
             return;
         }
         
@@ -253,299 +1490,337 @@ void TranslatorEngine::sendBatchRequest(const QJsonArray &batchArray, int startI
             int code = jsonObj["code"].toInt();
             if (code != 200) {
                 QString msg = jsonObj.value("msg").toString();
-                emit logMessage(QString("API returned error code %1: %2").arg(code).arg(msg));
+                emit logMessage(QString("API returned error code %1: %2").arg(code).arg(msg), LogError);
                 emit errorOccurred(QString("API Error: %1").arg(msg));
-                m_isRunning = false;
-                emit translationFinished();
+                finishRun();
                 return;
             }
         }
         
-        QString responseContent;
-        QJsonValue responseValue;
-        bool hasResponse = false;
-        bool isDirectData = false;
-        
-        // 支持多种响应格式
-        if (jsonObj.contains("response")) {
-            // Ollama 标准格式
-            QJsonValue respValue = jsonObj["response"];
-            if (respValue.isString()) {
-                QString respStr = respValue.toString().trimmed();
-                // 如果 response 为空，检查 thinking 字段（thinking models）
-                if (respStr.isEmpty() && jsonObj.contains("thinking")) {
-                    QJsonValue thinkingValue = jsonObj["thinking"];
-                    if (thinkingValue.isString()) {
-                        responseContent = thinkingValue.toString().trimmed();
-                        emit logMessage("Using 'thinking' field as response (thinking model detected)");
-                        hasResponse = true;
-                    }
-                } else if (!respStr.isEmpty()) {
-                    responseContent = respStr;
-                    // qDebug() << responseContent; // Avoid printing huge content
-                    hasResponse = true;
-                }
-            } else {
-                // response 可能是对象或数组
-                responseValue = respValue;
-                isDirectData = true;
-                hasResponse = true;
-            }
-        }
-        
-        // 如果 response 为空，尝试从 thinking 字段获取（thinking models）
-        if (!hasResponse && jsonObj.contains("thinking")) {
-            QJsonValue thinkingValue = jsonObj["thinking"];
-            if (thinkingValue.isString()) {
-                responseContent = thinkingValue.toString().trimmed();
-                emit logMessage("Using 'thinking' field as response (thinking model detected)");
-                hasResponse = true;
-            }
-        }
-        
-        if (!hasResponse && jsonObj.contains("data")) {
-            // 自定义格式：data 可能是字符串、对象或数组
-            QJsonValue dataValue = jsonObj["data"];
-            if (dataValue.isString()) {
-                responseContent = dataValue.toString().trimmed();
-                hasResponse = true;
-            } else {
-                // data 是对象或数组，直接使用
-                responseValue = dataValue;
-                isDirectData = true;
-                hasResponse = true;
-            }
-        }
-        
-        if (!hasResponse) {
-            emit logMessage("Invalid response format from API.");
-            emit logMessage("Response keys: " + jsonObj.keys().join(", "));
+        // The answer written by the model: "response" (/api/generate) or message.content
+        // (/api/chat), "thinking" for thinking models that leave it empty, or "data" of
+        // custom APIs, which may also carry the result as JSON directly
+        QByteArray content;
+        QJsonValue directValue;
+        if (jsonObj.value("response").isString() && !jsonObj.value("response").toString().trimmed().isEmpty()) {
+            content = jsonObj.value("response").toString().toUtf8();
+        } else if (jsonObj.value("thinking").isString()) {
+            content = jsonObj.value("thinking").toString().toUtf8();
+            emit logMessage("Using 'thinking' field as response (thinking model detected)", LogDebug);
+        } else if (jsonObj.value("response").isArray() || jsonObj.value("response").isObject()) {
+            directValue = jsonObj.value("response");
+        } else if (jsonObj.value("data").isString()) {
+            content = jsonObj.value("data").toString().toUtf8();
+        } else if (jsonObj.contains("data")) {
+            directValue = jsonObj.value("data");
+        } else {
+            emit logMessage("Invalid response format from API.", LogWarning);
+            emit logMessage("Response keys: " + jsonObj.keys().join(", "), LogDebug);
             
-            // 如果是分批处理模式，跳过当前批次继续处理
+            // 如果是分批处理模式，稍后重试当前批次并继续处理
             if (count < m_itemsToTranslate.size()) {
-                emit logMessage(QString("Skipping batch %1-%2 due to invalid response, continuing...").arg(startIdx + 1).arg(startIdx + count));
-                int nextIdx = startIdx + count;
-                if (nextIdx < m_itemsToTranslate.size()) {
-                    processBatch(nextIdx, 50);
-                    return;
-                }
+                recordBatch(*timing, jsonObj, count, 0);
+                finishBatch(requeueItems(items, "Invalid response"));
+                return;
             }
             
             emit errorOccurred("Invalid response format from API. Missing 'response' or 'data' field.");
-            m_isRunning = false;
-            emit translationFinished();
+            finishRun();
             return;
         }
         
-        QJsonDocument responseJsonDoc;
-        QJsonArray resultArray;
+        // One pass over the bytes: text around the JSON (markdown fences) is skipped, and a
+        // truncated or partly malformed array still yields every complete element
+        QList<QJsonObject> results;
+        bool complete = true;
+        if (directValue.isUndefined()) {
+            emit logMessage("Response content length: " + QString::number(content.size()), LogDebug);
+            results = TranslationStreamParser::parse(content, &complete);
+        } else {
+            QJsonArray array = directValue.toArray();
+            if (directValue.isObject()) {
+                array = directValue.toObject().value("translations").toArray();
+            }
+            for (const QJsonValue &val : array) {
+                if (val.isObject()) results.append(val.toObject());
+            }
+        }
+        if (!complete && !results.isEmpty()) {
+            emit logMessage(QString("Recovered %1 complete items from an unterminated response.").arg(results.size()), LogWarning);
+            truncated = true;
+        }
         
-        if (isDirectData) {
-            // 如果响应是直接的对象或数组，直接使用
-            if (responseValue.isArray()) {
-                resultArray = responseValue.toArray();
-            } else if (responseValue.isObject()) {
-                QJsonObject rootObj = responseValue.toObject();
-                if (rootObj.contains("translations") && rootObj["translations"].isArray()) {
-                    resultArray = rootObj["translations"].toArray();
-                }
+        if (!results.isEmpty()) {
+            emit logMessage(QString("Received %1 items in response.").arg(results.size()), LogDebug);
+            if (!results.first().contains("translation")) {
+                emit logMessage("Warning: Response items don't have 'translation' field. Keys: " + results.first().keys().join(", "), LogWarning);
+                emit logMessage("Expected format: Objects with 'id' and 'translation' fields.", LogDebug);
             }
-        } else {
-            // 需要解析字符串内容
-            emit logMessage("Response content length: " + QString::number(responseContent.length()));
             
-            // 由于使用了 format: "json" 参数，Ollama 应该返回纯 JSON 格式
-            // 但为了兼容性和健壮性，仍保留清理步骤以处理可能的边缘情况
-            // Clean up markdown if present (shouldn't happen with format: "json", but keep for safety)
-            if (responseContent.startsWith("```json")) {
-                responseContent = responseContent.mid(7);
-            } else if (responseContent.startsWith("```")) { // Handle cases where language isn't specified
-                 responseContent = responseContent.mid(3);
+            QSet<int> received;
+            for (int id : applyResults(results, items, escalated)) {
+                received.insert(id);
             }
-            if (responseContent.endsWith("```")) {
-                responseContent.chop(3);
+            const int successCount = received.size();
+            checkpoint(jobOf(items));
+            recordBatch(*timing, jsonObj, count, successCount);
+            
+            if (successCount == 0) {
+                emit logMessage("Warning: No valid translations found in response. Check if the response format matches expected format.", LogWarning);
             }
             
-            // Try to find the first '{' and last '}' to handle extra text (shouldn't be needed with format: "json")
-            int firstBrace = responseContent.indexOf('{');
-            int lastBrace = responseContent.lastIndexOf('}');
+            emit logMessage(QString("Successfully translated %1 of %2 items in batch.").arg(successCount).arg(count));
             
-            if (firstBrace != -1 && lastBrace != -1 && lastBrace > firstBrace) {
-                responseContent = responseContent.mid(firstBrace, lastBrace - firstBrace + 1);
-            } else if (firstBrace == -1) {
-                // 如果找不到外层大括号，尝试查找是否是纯数组（有些模型可能直接返回数组）
-                int firstBracket = responseContent.indexOf('[');
-                int lastBracket = responseContent.lastIndexOf(']');
-                if (firstBracket != -1 && lastBracket != -1 && lastBracket > firstBracket) {
-                     responseContent = responseContent.mid(firstBracket, lastBracket - firstBracket + 1);
-                }
+            // 模型漏掉或返回空译文的条目：只把这些条目放回队列
+            QVector<int> missing;
+            for (int i : items) {
+                if (!received.contains(i)) missing.append(i);
             }
-
-            responseJsonDoc = QJsonDocument::fromJson(responseContent.toUtf8());
-            
-            if (responseJsonDoc.isObject()) {
-                 QJsonObject rootObj = responseJsonDoc.object();
-                 
-                 // 检查是否有 translations 字段
-                 if (rootObj.contains("translations") && rootObj["translations"].isArray()) {
-                     resultArray = rootObj["translations"].toArray();
-                 }
-                 // 检查是否有 data 字段（自定义格式）
-                 else if (rootObj.contains("data")) {
-                     QJsonValue dataValue = rootObj["data"];
-                     if (dataValue.isArray()) {
-                         resultArray = dataValue.toArray();
-                     } else if (dataValue.isObject()) {
-                         // data 是对象，可能包含 translations
-                         QJsonObject dataObj = dataValue.toObject();
-                         if (dataObj.contains("translations") && dataObj["translations"].isArray()) {
-                             resultArray = dataObj["translations"].toArray();
-                         }
-                     }
-                 }
-            } else if (responseJsonDoc.isArray()) {
-                resultArray = responseJsonDoc.array();
+            int givenUp = 0;
+            if (!missing.isEmpty()) {
+                givenUp = requeueItems(missing, truncated ? "Response truncated" : "Items missing from response");
             }
+            
+            // 继续调度下一批（或在全部完成时结束）
+            finishBatch(successCount + givenUp);
+            return;
+        }
+        
+        emit logMessage("Error: API response is not a valid JSON array or doesn't contain translations.", LogWarning);
+        if (m_logLevel >= LogDebug && directValue.isUndefined()) {
+            emit logMessage("Response content (first 1000 chars): " + QString::fromUtf8(content.left(1000)), LogDebug);
+        }
+        
+        recordBatch(*timing, jsonObj, count, 0);
+        
+        // 空响应或被截断的响应：将批次一分为二后重试，而不是直接丢弃
+        if (count > 1) {
+            splitBatch(items, truncated ? "Response truncated" : "Empty or invalid response");
+            return;
+        }
+        
+        if (m_itemsToTranslate.size() > 1) {
+            finishBatch(requeueItems(items, QString("No result for item %1").arg(items.first() + 1)));
+            return;
+        } else if (directValue.isUndefined() && (content.trimmed() == "{}" || content.trimmed().isEmpty())) {
+            emit errorOccurred("API returned empty response. The request might be too large.");
+        } else {
+            emit errorOccurred("API response is not a valid translation result format.");
         }
+        finishBatch(count);
+    });
+}
 
-            if (!resultArray.isEmpty()) {
-                emit logMessage(QString("Received %1 items in response.").arg(resultArray.size()));
-                
-                // 检查第一个元素的格式
-                if (!resultArray.isEmpty()) {
-                    QJsonObject firstObj = resultArray[0].toObject();
-                    QStringList keys = firstObj.keys();
-                    if (!keys.contains("translation")) {
-                        emit logMessage("Warning: Response items don't have 'translation' field. Keys: " + keys.join(", "));
-                        emit logMessage("Expected format: Objects with 'id' and 'translation' fields.");
-                    }
-                }
-                
-                int successCount = 0;
-                for (const QJsonValue &val : resultArray) {
-                    if (!val.isObject()) continue;
-                    
-                    QJsonObject obj = val.toObject();
-                    int id = obj["id"].toInt();
-                    QString translation = obj["translation"].toString();
-                    
-                    if (id >= 0 && id < m_itemsToTranslate.size() && !translation.isEmpty()) {
-                        TranslationItem &item = m_itemsToTranslate[id];
-                        
-                        // Update DOM
-                        // Remove all existing children (text, comments, etc.) to ensure clean replacement
-                        while (!item.element.firstChild().isNull()) {
-                            item.element.removeChild(item.element.firstChild());
-                        }
-                        QDomText textNode = m_doc.createTextNode(translation);
-                        item.element.appendChild(textNode);
-                        
-                        if (item.element.hasAttribute("type")) {
-                            item.element.removeAttribute("type");
-                        }
-                        
-                        successCount++;
-                    }
-                }
-                
-                if (successCount == 0 && !resultArray.isEmpty()) {
-                    emit logMessage("Warning: No valid translations found in response. Check if the response format matches expected format.");
-                }
-                
-                emit logMessage(QString("Successfully translated %1 items.").arg(successCount));
-                
-                // 如果是分批处理模式，继续处理下一批
-                if (count < m_itemsToTranslate.size()) {
-                    int nextIdx = startIdx + count;
-                    if (nextIdx < m_itemsToTranslate.size()) {
-                        processBatch(nextIdx, 50); // 继续处理下一批
-                        return;
-                    }
-                }
-                
-                emit progressUpdated(startIdx + count, m_itemsToTranslate.size());
-                
-                // 如果这是最后一批，标记为完成
-                if (startIdx + count >= m_itemsToTranslate.size()) {
-                    m_isRunning = false;
-                    emit translationFinished();
-                }
-            } else {
-                emit logMessage("Error: API response is not a valid JSON array or doesn't contain translations.");
-                
-                // 检查返回的数据格式
-                if (isDirectData && responseValue.isArray()) {
-                    QJsonArray dataArray = responseValue.toArray();
-                    if (!dataArray.isEmpty()) {
-                        QJsonObject firstItem = dataArray[0].toObject();
-                        QStringList keys = firstItem.keys();
-                        emit logMessage("Returned data format: Array with keys: " + keys.join(", "));
-                        emit logMessage("Expected format: Array of objects with 'id' and 'translation' fields.");
-                        
-                        if (!keys.contains("translation")) {
-                            emit errorOccurred("API returned data in wrong format. Expected translation results with 'id' and 'translation' fields, but got: " + keys.join(", "));
-                        }
-                    }
-                } else if (!isDirectData) {
-                    emit logMessage("Response content (first 1000 chars): " + responseContent.left(1000));
-                    if (responseJsonDoc.isObject()) {
-                        QJsonObject parsedObj = responseJsonDoc.object();
-                        QStringList keys = parsedObj.keys();
-                        emit logMessage("Parsed JSON object keys: " + keys.join(", "));
-                        
-                        // 检查是否有 data 字段
-                        if (parsedObj.contains("data")) {
-                            QJsonValue dataValue = parsedObj["data"];
-                            emit logMessage("Found 'data' field in response.");
-                            if (dataValue.isObject()) {
-                                QJsonObject dataObj = dataValue.toObject();
-                                emit logMessage("Data object keys: " + dataObj.keys().join(", "));
-                                emit logMessage("Warning: Model returned data in wrong format. Expected: {\"translations\": [...]}, but got data object with different structure.");
-                            } else if (dataValue.isArray()) {
-                                QJsonArray dataArray = dataValue.toArray();
-                                emit logMessage(QString("Data is an array with %1 items.").arg(dataArray.size()));
-                                if (!dataArray.isEmpty()) {
-                                    QJsonObject firstItem = dataArray[0].toObject();
-                                    emit logMessage("First data item keys: " + firstItem.keys().join(", "));
-                                }
-                            }
-                        }
-                    }
-                }
-                
-                // 如果响应是空对象，可能是请求太大，自动回退到分批处理
-                if ((!isDirectData && (responseContent == "{}" || responseContent.isEmpty())) && count == m_itemsToTranslate.size()) {
-                    emit logMessage("Request too large, falling back to batch processing...");
-                    m_currentIndex = 0;
-                    processBatch(0, 50); // 使用 50 个一批
-                    return;
-                } else {
-                    // 如果是分批处理模式，跳过当前批次继续处理
-                    if (count < m_itemsToTranslate.size()) {
-                        emit logMessage(QString("Skipping batch %1-%2 due to error, continuing...").arg(startIdx + 1).arg(startIdx + count));
-                        int nextIdx = startIdx + count;
-                        if (nextIdx < m_itemsToTranslate.size()) {
-                            processBatch(nextIdx, 50);
-                            return;
-                        }
-                    }
-                    
-                    if (!isDirectData && (responseContent == "{}" || responseContent.isEmpty())) {
-                        emit errorOccurred("API returned empty response. The request might be too large.");
-                    } else {
-                        emit errorOccurred("API response is not a valid translation result format.");
-                    }
-                }
+QVector<int> TranslatorEngine::applyResults(const QList<QJsonObject> &results, const QVector<int> &items, bool escalated)
+{
+    // First pass of the cascade: results are checked before they are applied
+    const bool validate = !escalated && !m_escalationModel.isEmpty();
+    
+    QVector<PendingResult> pending;
+    pending.reserve(results.size());
+    for (const QJsonObject &obj : results) {
+        // Ids are positions in the batch (1..n)
+        int local = obj["id"].toInt(0);
+        QString translation = obj["translation"].toString();
+        
+        // 只接受属于本批次的 id，避免乱序完成时写错条目
+        if (local < 1 || local > items.size() || translation.isEmpty()) {
+            continue;
+        }
+        const int id = items[local - 1];
+        const TranslationItem &item = m_itemsToTranslate[id];
+        pending.append({id, item.source, translation, validate ? &m_jobs[item.job].validator : nullptr});
+    }
+    
+    // The checks only read their input, so a large answer is checked on all cores;
+    // everything that changes the engine's state stays below, on this thread
+    QVector<CheckedResult> checked;
+    if (pending.size() >= kParallelCheckResults) {
+        checked = QtConcurrent::blockingMapped<QVector<CheckedResult>>(pending, checkResult);
+    } else {
+        checked.reserve(pending.size());
+        for (const PendingResult &result : pending) {
+            checked.append(checkResult(result));
+        }
+    }
+    
+    QVector<int> applied;
+    for (const CheckedResult &result : checked) {
+        const int id = result.id;
+        TranslationItem &item = m_itemsToTranslate[id];
+        
+        // Missing or duplicated sentinels: treat the item as unanswered so it is sent again
+        if (!result.markupKept) {
+            emit logMessage(QString("Placeholders or markup lost in the translation of \"%1\", retrying.").arg(item.source.left(80)), LogWarning);
+            continue;
+        }
+        TranslationJob &job = m_jobs[item.job];
+        
+        // A suspect first-pass result is kept provisionally and the item is sent again
+        // to the escalation model; memory and journal only get the final result
+        if (validate) {
+            if (m_escalatedItems.contains(id)) {
+                // Repeated in the same answer
+                applied.append(id);
+                continue;
             }
+            if (!result.reason.isEmpty()) {
+                applyTranslation(item, result.translation);
+                m_escalatedItems.insert(id);
+                job.escalations.append(id);
+                m_stats.itemsFlagged++;
+                // Counted as processed when its escalation batch completes
+                m_processedCount--;
+                emit logMessage(QString("Escalating \"%1\" (%2).").arg(item.source.left(80), result.reason), LogDebug);
+                applied.append(id);
+                continue;
+            }
+        }
         
-        // 只有在不是分批处理模式或所有批次都完成时才结束
-        // 注意：如果是分批处理，processBatch 会继续调用 sendBatchRequest，所以这里不需要结束
-        // 修改：因为上面已经在成功处理后判断了是否完成，这里只处理非分批（一次性）的情况或者异常退出的情况
-        // 但由于我们现在强制分批，这里的逻辑其实在上面已经处理了。
-        // 为了安全起见，我们保留这个检查，但确保不会重复触发
-        if (m_isRunning && count >= m_itemsToTranslate.size()) {
-            m_isRunning = false;
-            emit translationFinished();
+        // Update document
+        applyTranslation(item, result.translation);
+        m_stats.itemsTranslated++;
+        if (escalated) {
+            m_stats.itemsEscalated++;
         }
-    });
+        QByteArray key = TranslationMemory::makeKey(item.source, item.context, job.targetLang, m_modelName);
+        if (m_memory.isOpen()) {
+            m_memory.insert(key, result.translation);
+        }
+        if (job.journal) {
+            job.journal->insert(key, result.translation);
+        }
+        applied.append(id);
+    }
+    return applied;
+}
+
+void TranslatorEngine::consumeStream(StreamState &state, const QByteArray &data, const QVector<int> &items)
+{
+    state.lineBuffer.append(data);
+    
+    int newline;
+    while ((newline = state.lineBuffer.indexOf('\n')) >= 0) {
+        const QByteArray line = state.lineBuffer.left(newline).trimmed();
+        state.lineBuffer.remove(0, newline + 1);
+        if (line.isEmpty()) continue;
+        
+        // Ollama 流式输出：每行一个 JSON 对象，"response" 为本次生成的文本片段
+        QJsonObject chunk = QJsonDocument::fromJson(line).object();
+        if (chunk.contains("error")) {
+            state.error = chunk["error"].toString();
+            continue;
+        }
+        if (chunk["done"].toBool()) {
+            state.finalChunk = chunk;
+        }
+        
+        const QString fragment = chunk.contains("message") ? chunk["message"].toObject()["content"].toString()
+                                                           : chunk["response"].toString();
+        if (fragment.isEmpty()) continue;
+        
+        int applied = 0;
+        for (int id : applyResults(state.parser.feed(fragment.toUtf8()), items, state.escalated)) {
+            if (!state.received.contains(id)) {
+                state.received.insert(id);
+                applied++;
+            }
+        }
+        if (applied > 0) {
+            m_processedCount += applied;
+            emit progressUpdated(m_processedCount, m_itemsToTranslate.size());
+        }
+    }
+}
+
+void TranslatorEngine::finishStreamedBatch(StreamState &state, const RequestTiming &timing, const QVector<int> &items)
+{
+    // The last line may come without a trailing newline
+    if (!state.lineBuffer.trimmed().isEmpty()) {
+        consumeStream(state, "\n", items);
+    }
+    checkpoint(jobOf(items));
+    recordBatch(timing, state.finalChunk, items.size(), state.received.size());
+    
+    if (!state.error.isEmpty()) {
+        emit logMessage("API Error: " + state.error, LogError);
+        emit errorOccurred("API Error: " + state.error);
+        finishRun();
+        return;
+    }
+    
+    // A stream that ends without "done": true was cut off as well
+    bool truncated = state.finalChunk.isEmpty() || state.finalChunk.value("done_reason").toString() == "length";
+    
+    QVector<int> missing;
+    for (int i : items) {
+        if (!state.received.contains(i)) missing.append(i);
+    }
+    emit logMessage(QString("Successfully translated %1 of %2 items in streamed batch.").arg(state.received.size()).arg(items.size()));
+    
+    if (missing.isEmpty()) {
+        finishBatch(0);
+    } else if (state.received.isEmpty()) {
+        // Nothing usable: same handling as an empty non-streamed response
+        if (items.size() > 1) {
+            splitBatch(items, truncated ? "Response truncated" : "Empty or invalid response");
+        } else {
+            finishBatch(requeueItems(items, QString("No result for item %1").arg(items.first() + 1)));
+        }
+    } else if (truncated) {
+        // Keep what was already applied and retry only the rest
+        emit logMessage(QString("Response truncated: retrying the remaining %1 items...").arg(missing.size()), LogWarning);
+        jobOf(missing).pendingBatches.prepend(missing);
+        finishBatch(0);
+    } else {
+        emit logMessage(QString("Warning: %1 items were missing from the response.").arg(missing.size()), LogWarning);
+        finishBatch(requeueItems(missing, "Items missing from response"));
+    }
+}
+
+void TranslatorEngine::recordBatch(const RequestTiming &timing, const QJsonObject &ollamaTiming, int items, int applied)
+{
+    m_metrics.recordBatch(items, applied, timing.timer.elapsed(), timing.firstByteMs, timing.promptTokens, ollamaTiming);
+    m_endpoints.reportSuccess(timing.endpoint, applied, timing.timer.elapsed());
+    
+    const int outputTokens = ollamaTiming.value("eval_count").toInt();
+    const qint64 evalNs = qint64(ollamaTiming.value("eval_duration").toDouble());
+    if (outputTokens > 0 && evalNs > 0) {
+        emit logMessage(QString("Batch timing: %1 ms wall, %2 prompt / %3 output tokens, %4 tokens/s")
+                        .arg(timing.timer.elapsed()).arg(ollamaTiming.value("prompt_eval_count").toInt())
+                        .arg(outputTokens).arg(outputTokens * 1e9 / evalNs, 0, 'f', 1), LogDebug);
+    }
+}
+
+void TranslatorEngine::probeEndpoints()
+{
+    if (!m_isRunning) return;
+    
+    for (int index : m_endpoints.probeDue()) {
+        const QString url = m_endpoints.endpoint(index).url;
+        QNetworkReply *reply = m_networkManager->get(QNetworkRequest(QUrl(EndpointPool::siblingUrl(url, "tags"))));
+        connect(reply, &QNetworkReply::finished, this, [this, reply, index, url]() {
+            reply->deleteLater();
+            if (!m_isRunning) return;
+            
+            const bool ok = reply->error() == QNetworkReply::NoError;
+            m_endpoints.reportProbe(index, ok);
+            if (ok) {
+                emit logMessage(QString("Endpoint %1 is back in rotation.").arg(url));
+            } else if (m_endpoints.endpoint(index).dead) {
+                emit logMessage(QString("Endpoint %1 dropped: %2").arg(url).arg(reply->errorString()), LogWarning);
+            }
+            scheduleProbe();
+            dispatchBatches();
+        });
+    }
+    scheduleProbe();
+}
+
+void TranslatorEngine::scheduleProbe()
+{
+    const int delay = m_endpoints.msUntilNextProbe();
+    if (delay >= 0 && (!m_probeTimer.isActive() || m_probeTimer.remainingTime() > delay)) {
+        m_probeTimer.start(delay);
+    }
 }
@@ -2,7 +2,7 @@
 #define TRANSLATORENGINE_H
 
 #include <QObject>
-#include <QDomDocument>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
@@ -10,22 +10,99 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <QPair>
+#include <QSharedPointer>
+#include <QVector>
+#include <functional>
+#include "EndpointPool.h"
+#include "FuzzyIndex.h"
+#include "MetricsCollector.h"
+#include "TranslationMemory.h"
+#include "TranslationSnapshot.h"
+#include "TranslationValidator.h"
+#include "TsDocument.h"
 
 struct TranslationItem {
     QString context;
     QString source;
     QString translation;
-    QDomElement element; // Reference to the XML element to update
+    int job = 0;             // Index of the target language job this item belongs to
+    int offset = -1;         // Offset of the <translation> element in the document
+    // Other messages with the same source and target language, updated with the same
+    // result: (job, offset). In project mode they may belong to other files.
+    QVector<QPair<int, int>> duplicates;
+};
+
+// Everything that is specific to one target language of a document. All jobs of a
+// document share the parsed file; each one is written to its own output file.
+struct TranslationJob {
+    int document = 0;                   // Index in TranslatorEngine::m_documents
+    QString targetLang;
+    QHash<int, QString> translations;   // Patches applied on save, keyed by element offset
+    QList<QVector<int>> pendingBatches; // Batches (item indices) waiting to be dispatched
+    QSharedPointer<TranslationMemory> journal; // Checkpoint journal of this run, if enabled
+    QString autosavePath;               // Empty when autosave is off
+    int unsavedBatches = 0;             // Batches completed since the last (auto)save
+    QElapsedTimer lastAutosave;
+    TranslationValidator validator;     // Checks first-pass results when escalation is on
+    QVector<int> escalations;           // Flagged items waiting for an escalation batch
+    TranslationSnapshot snapshot;       // Translations as of the last save of this language
+};
+
+// Counters of the last run, used by the benchmark and the run report
+struct TranslationStats {
+    int requests = 0;          // HTTP requests sent
+    qint64 bytesSent = 0;      // Request bodies
+    qint64 bytesReceived = 0;  // Response bodies
+    int itemsTranslated = 0;   // Items with a result from the model
+    int itemsResolved = 0;     // Items taken from the checkpoint journal or translation memory
+    int failedBatches = 0;     // Batches that were split or skipped
+    int itemsFlagged = 0;      // First-pass results the validator sent to the escalation model
+    int itemsEscalated = 0;    // Items translated by the escalation model (part of itemsTranslated)
+    qint64 parseNs = 0;        // Parsing responses and applying results, without disk I/O
+    qint64 wallMs = 0;         // startTranslation() until translationFinished()
 };
 
 class TranslatorEngine : public QObject {
     Q_OBJECT
 
 public:
+    // Severity of a log message; LogDebug includes raw request / response payloads
+    enum LogLevel {
+        LogError,
+        LogWarning,
+        LogInfo,
+        LogDebug
+    };
+    Q_ENUM(LogLevel)
+    
+    // How identical source strings are merged into a single batch slot
+    enum DedupeMode {
+        DedupeOff,        // One item per <message>
+        DedupeGlobal,     // One item per distinct source text in the file
+        DedupePerContext  // One item per distinct (context, comment, source text)
+    };
+
+    // The engine is not thread-safe: it may live on a worker thread (moveToThread()), but
+    // must then only be called from that thread, e.g. through QMetaObject::invokeMethod().
+    // Its member objects (network manager, timers) are children and move with it.
     explicit TranslatorEngine(QObject *parent = nullptr);
     
     bool loadFile(const QString &filePath);
-    bool saveFile(const QString &filePath);
+    // Saves the translations of one target language (the first one if empty)
+    bool saveFile(const QString &filePath, const QString &targetLang = QString());
+    
+    // Project mode: every .ts file below dirPath is parsed (in parallel) and translated into
+    // its own <TS language>; files without one are skipped. Identical sources of the same
+    // language are translated once for the whole project and written into every file that
+    // contains them. A non-empty targetLangs list of startTranslation() selects the languages
+    // to translate; saveProject() writes all files back in place.
+    bool loadProject(const QString &dirPath);
+    bool saveProject();
+    bool isProjectMode() const;
     
     // Returns total unfinished items count
     int getUnfinishedCount() const;
@@ -33,31 +110,249 @@ public:
     // Start translation process
     // retranslateAll: if true, translate all items even if they are already translated
     void startTranslation(const QString &targetLang, const QString &apiUrl, const QString &modelName, bool retranslateAll = false);
+    // Translate the loaded file into several languages at once. The file is parsed once and
+    // the batches of all languages are interleaved over the available request slots.
+    // apiUrl may list several servers ("url|model|slots, ..."; see EndpointPool); missing
+    // models and slot counts default to modelName and maxConcurrency(). The translation
+    // memory and checkpoint journal are keyed by modelName whichever server answered.
+    void startTranslation(const QStringList &targetLangs, const QString &apiUrl, const QString &modelName, bool retranslateAll = false);
+    // Loads the model (and the escalation model) on every server of apiUrl with an empty
+    // generate request, so the first batch does not wait for the model load. Meant to be
+    // called as soon as the input is known, before the run is configured and started.
+    void warmUp(const QString &apiUrl, const QString &modelName);
+    // Cancels requests in flight and ends the run with translationFinished(); translations
+    // applied so far are kept
     void stopTranslation();
     
+    QStringList targetLanguages() const;
+    
+    // Counters of the current (or last finished) run
+    const TranslationStats &runStats() const;
+    // Per-batch latency / token metrics of the current (or last finished) run
+    const MetricsCollector &metrics() const;
+    
+    // Maximum number of batch requests kept in flight at the same time (per endpoint).
+    // Should match the number of parallel slots of the Ollama server (OLLAMA_NUM_PARALLEL).
+    void setMaxConcurrency(int count);
+    int maxConcurrency() const;
+    
+    // Persistent translation memory consulted before any LLM call.
+    // An empty path uses TranslationMemory::defaultPath().
+    void setTranslationMemoryEnabled(bool enabled);
+    bool isTranslationMemoryEnabled() const;
+    void setTranslationMemoryPath(const QString &path);
+    
+    // Crash-safe checkpoint journal: every applied result is appended and fsync'd per batch,
+    // and replayed by the next startTranslation() for the same file, language and model.
+    // The journal is deleted once the language has been saved after the run.
+    void setJournalEnabled(bool enabled);
+    bool isJournalEnabled() const;
+    
+    // Incremental runs: saving a language records the (context, source) hash and translation
+    // of every translated message. The next run of the same file and language restores
+    // unchanged messages that lost their translation and also schedules finished messages
+    // whose translation was saved for a different source. Finished messages the snapshot
+    // does not know are kept. Retranslate All ignores the snapshot.
+    void setSnapshotEnabled(bool enabled);
+    bool isSnapshotEnabled() const;
+    
+    // Model context window in tokens (sent as options.num_ctx). Batches are sized so that
+    // prompt, input and expected output fit into it.
+    void setContextSize(int tokens);
+    int contextSize() const;
+    // Upper bound of items per batch, even when the token budget would allow more
+    void setMaxBatchItems(int count);
+    int maxBatchItems() const;
+    
+    // Transient HTTP / network errors (connection refused, timeouts, 429, 5xx) are retried
+    // with exponential backoff and jitter up to this many times per batch before the run
+    // is aborted. Items missing from an answer get the same number of further attempts.
+    void setMaxRetries(int count);
+    int maxRetries() const;
+    
+    // Streaming mode: request "stream": true and apply every translation object as soon
+    // as it is complete instead of waiting for the whole batch
+    void setStreamingEnabled(bool enabled);
+    bool isStreamingEnabled() const;
+    
+    // Prefix reuse: send batches to /api/chat with a byte-identical system message and
+    // the batch payload strictly last, so Ollama can keep the evaluated instruction
+    // prefix in its KV cache. keepAlive is sent as "keep_alive" (e.g. "30m", "-1") with
+    // every request, so the model also stays loaded between runs.
+    void setPrefixCacheEnabled(bool enabled);
+    bool isPrefixCacheEnabled() const;
+    void setKeepAlive(const QString &duration);
+    QString keepAlive() const;
+    
+    // Autosave: while a run is in progress every language is written to pathPattern (see
+    // outputPath()) once everyBatches of its batches have completed or intervalSeconds have
+    // passed since its last write, and once more when the run ends. Files are replaced
+    // atomically, so an interrupted write never leaves a truncated .ts behind. An empty
+    // pattern disables autosaving; takes effect on the next startTranslation().
+    void setAutosave(const QString &pathPattern, int everyBatches = 10, int intervalSeconds = 60);
+    QString autosavePattern() const;
+    
+    // {dir}, {name} (base name of input without .ts) and {lang} (spaces replaced by '_')
+    static QString outputPath(const QString &pattern, const QString &input, const QString &lang);
+    
+    // Finished translations already in the file are indexed when it is loaded. Unless all
+    // items are retranslated, a source that differs from a finished one only in numbers or
+    // trailing punctuation is resolved locally, and the closest finished translations are
+    // sent with each batch as few-shot examples.
+    void setFuzzyMatchingEnabled(bool enabled);
+    bool isFuzzyMatchingEnabled() const;
+    
+    // Model cascade: results of the default model that fail TranslationValidator are kept
+    // provisionally and translated again by this (larger) model on the same server; the
+    // escalated result is final. Empty disables the cascade.
+    void setEscalationModel(const QString &model);
+    QString escalationModel() const;
+    
+    // Rough token count of a text for batch sizing (no tokenizer available locally)
+    static int estimateTokens(const QString &text);
+    
+    // Payload dumps (raw responses) are only built at LogDebug; receivers of logMessage()
+    // filter the other levels themselves
+    void setLogLevel(LogLevel level);
+    LogLevel logLevel() const;
+    
+    // Takes effect on the next prepareItems(). In project mode DedupeGlobal merges like
+    // DedupePerContext: the same text can mean different things in different modules.
+    void setDedupeMode(DedupeMode mode);
+    DedupeMode dedupeMode() const;
+    
     // Prepare items to translate based on the flag
     void prepareItems(bool retranslateAll);
 
 signals:
     void progressUpdated(int current, int total);
-    void logMessage(const QString &msg);
+    void logMessage(const QString &msg, TranslatorEngine::LogLevel level = LogInfo);
     void translationFinished();
     void errorOccurred(const QString &err);
 
 private:
-    void sendBatchRequest(const QJsonArray &batchArray, int startIdx, int count);
-    void processBatch(int startIdx, int batchSize);
+    struct StreamState;
+    struct RequestTiming;
 
-    QDomDocument m_doc;
+    void sendBatchRequest(const QJsonArray &batchArray, const QJsonArray &examples, const QVector<int> &items, int endpoint);
+    void processBatch(const QVector<int> &items, int endpoint);
+    QString buildPrompt(const QString &inputJson, int count, const QString &targetLang, const QString &examplesJson) const;
+    // Prefix reuse mode: constant instructions, and the per-batch message that follows them
+    static QString systemPrompt();
+    QString buildUserMessage(const QString &inputJson, int count, const QString &targetLang, const QString &examplesJson) const;
+    // Few-shot block placed before the batch input; empty without examples
+    static QString examplesSection(const QString &examplesJson);
+    // Pack m_itemsToTranslate into the per-job batch queues using the token budget, grouping
+    // items by length class and <context>
+    void buildBatches();
+    // Tokens left for the items of one batch of a job
+    int tokenBudget(int job) const;
+    // Pack flagged items into escalation batches once the job's first pass is dispatched
+    // or enough of them have gathered
+    void queueEscalations();
+    // Bisect a failed batch and queue both halves for an immediate retry
+    void splitBatch(const QVector<int> &items, const QString &reason);
+    // Apply the {"id", "translation"} result objects of one answer; returns the indexes of
+    // the items that got a translation. Unmasking and validation run on the global
+    // thread pool for larger answers. escalated: the batch was answered by the escalation model
+    QVector<int> applyResults(const QList<QJsonObject> &results, const QVector<int> &items, bool escalated);
+    // Streaming mode: split NDJSON chunks into lines and apply completed objects
+    void consumeStream(StreamState &state, const QByteArray &data, const QVector<int> &items);
+    void finishStreamedBatch(StreamState &state, const RequestTiming &timing, const QVector<int> &items);
+    // Feed one finished request into the metrics; ollamaTiming is the (final) response envelope
+    void recordBatch(const RequestTiming &timing, const QJsonObject &ollamaTiming, int items, int applied);
+    // Fill the request window with new batches, or finish the run when everything is done
+    void dispatchBatches();
+    bool hasPendingBatches() const;
+    // Target language job of a batch
+    TranslationJob &jobOf(const QVector<int> &items);
+    // Called once per completed (or skipped) batch
+    void finishBatch(int count);
+    // Queue items without a usable result for a later batch; returns how many were given up
+    int requeueItems(const QVector<int> &items, const QString &reason);
+    // Send a batch again, after a backoff delay unless another endpoint can take it right
+    // away; false when it has no retries left
+    bool scheduleRetry(const QVector<int> &items, const QString &reason, int failedEndpoint);
+    // Send a recovery probe to every endpoint that is out of rotation and due
+    void probeEndpoints();
+    void scheduleProbe();
+    // Stop dispatching, cancel outstanding requests and emit translationFinished()
+    void finishRun();
+    // Add the time since the response handler started to the parse statistics
+    void endParseTiming();
+    void abortActiveReplies();
+    bool openMemory();
+    // Resolve items from the translation memory and drop them from m_itemsToTranslate
+    void resolveFromMemory();
+    // Rebuild m_fuzzyIndexes from the finished messages of the documents
+    void indexFinishedTranslations();
+    // Resolve items that are near-identical to a finished translation of the document
+    void resolveFromIndex();
+    // Open the checkpoint journals of all jobs and apply what earlier runs recorded
+    void replayJournals();
+    // Load the snapshot of every job (before prepareItems()); true if any is not empty
+    bool loadSnapshots();
+    // Record the translations the saved file of a job holds
+    void writeSnapshot(TranslationJob &job);
+    bool saveJob(TranslationJob &job, const QString &filePath);
+    // Apply every item the lookup returns a translation for and drop it from m_itemsToTranslate
+    int resolveItems(const std::function<bool(const TranslationItem &, QString *)> &lookup);
+    // Persist the results of a completed batch
+    void checkpoint(TranslationJob &job);
+    // Write the job to its autosave path if anything changed since the last write
+    void autosave(TranslationJob &job);
+    // Record a translation for the <translation> elements of an item
+    void applyTranslation(TranslationItem &item, const QString &translation);
+
+    QVector<TsDocument> m_documents;   // The loaded file, or all files of a project
+    bool m_projectMode;
+    QVector<TranslationJob> m_jobs;
+    int m_nextJob;          // Round-robin cursor over m_jobs for dispatching
     QList<TranslationItem> m_itemsToTranslate;
-    int m_currentIndex;
+    int m_processedCount;   // Items whose batch has completed
+    int m_maxConcurrency;
+    int m_contextSize;
+    int m_maxBatchItems;
+    int m_maxRetries;
+    bool m_streaming;
+    bool m_prefixCache;
+    QString m_keepAlive;
+    LogLevel m_logLevel;
     bool m_isRunning;
     
-    QString m_targetLang;
-    QString m_apiUrl;
-    QString m_modelName;
+    QSet<QNetworkReply*> m_activeReplies;
+    QSet<QTimer*> m_retryTimers;   // Batches waiting for their backoff delay
+    EndpointPool m_endpoints;
+    QTimer m_probeTimer;           // Child of the engine, so it follows moveToThread()
+    QHash<int, int> m_itemAttempts; // Item index -> answers without a result for it
+    QHash<QVector<int>, int> m_batchRetries; // Items of a batch -> transient errors so far
+    
+    TranslationStats m_stats;
+    MetricsCollector m_metrics;
+    QElapsedTimer m_runTimer;
+    QElapsedTimer m_parseTimer;
+    
+    QString m_modelName;    // Default model, also the key of memory and journal entries
+    QString m_escalationModel;
+    QSet<int> m_escalatedItems; // Items flagged this run; their batches go to m_escalationModel
     
     QNetworkAccessManager *m_networkManager;
+    
+    TranslationMemory m_memory;
+    QString m_memoryPath;
+    bool m_memoryEnabled;
+    bool m_journalEnabled;
+    bool m_snapshotEnabled;
+    
+    QString m_autosavePattern;
+    int m_autosaveBatches;
+    int m_autosaveIntervalMs;
+    
+    QVector<FuzzyIndex> m_fuzzyIndexes; // Finished translations, one index per document
+    bool m_fuzzyEnabled;
+    bool m_useFuzzyIndex;       // This run: enabled, index not empty and not retranslating all
+    
+    DedupeMode m_dedupeMode;
 };
 
 #endif // TRANSLATORENGINE_H
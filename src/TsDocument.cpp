@@ -0,0 +1,313 @@
+#include "TsDocument.h"
+#include <QFile>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QVector>
+#include <QXmlStreamReader>
+#include <algorithm>
+
+namespace {
+const char kUtf8Bom[] = "\xEF\xBB\xBF";
+
+// Escapes text the same way lupdate does for element content
+QString escapeXml(const QString &text)
+{
+    QString result;
+    result.reserve(text.size() + text.size() / 8);
+    for (QChar ch : text) {
+        switch (ch.unicode()) {
+        case '&': result += QLatin1String("&amp;"); break;
+        case '<': result += QLatin1String("&lt;"); break;
+        case '>': result += QLatin1String("&gt;"); break;
+        case '"': result += QLatin1String("&quot;"); break;
+        case '\'': result += QLatin1String("&apos;"); break;
+        case '\t': case '\n': case '\r': result += ch; break;
+        default:
+            if (ch.unicode() < 0x20) {
+                result += QString("&#x%1;").arg(ch.unicode(), 0, 16);
+            } else {
+                result += ch;
+            }
+            break;
+        }
+    }
+    return result;
+}
+}
+
+TsDocument::TsDocument()
+{
+}
+
+bool TsDocument::load(const QString &filePath, QString *errorString)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = "Failed to open file: " + filePath;
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    if (!setContent(data, errorString)) {
+        return false;
+    }
+    m_filePath = filePath;
+    return true;
+}
+
+bool TsDocument::setContent(const QByteArray &data, QString *errorString)
+{
+    clear();
+
+    m_data = data;
+    if (!parse(errorString)) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+void TsDocument::clear()
+{
+    m_data.clear();
+    m_entries.clear();
+    m_contexts.clear();
+    m_types.clear();
+    m_filePath.clear();
+    m_language.clear();
+    m_sourceLanguage.clear();
+}
+
+bool TsDocument::isNull() const
+{
+    return m_data.isEmpty();
+}
+
+QString TsDocument::filePath() const
+{
+    return m_filePath;
+}
+
+QString TsDocument::language() const
+{
+    return m_language;
+}
+
+QString TsDocument::sourceLanguage() const
+{
+    return m_sourceLanguage;
+}
+
+void TsDocument::scan(const std::function<bool(const Message &)> &visitor) const
+{
+    for (const Entry &entry : m_entries) {
+        Message message;
+        if (entry.context >= 0) message.context = m_contexts.at(entry.context);
+        message.source = elementText(entry.source);
+        if (entry.comment >= 0) message.comment = elementText(entry.comment);
+        message.translation = elementText(entry.offset);
+        message.type = m_types.at(entry.type);
+        message.offset = entry.offset;
+        message.length = entry.length;
+        if (!visitor(message)) return;
+    }
+}
+
+bool TsDocument::parse(QString *errorString)
+{
+    const int bomSize = m_data.startsWith(kUtf8Bom) ? 3 : 0;
+    QXmlStreamReader xml(QByteArray::fromRawData(m_data.constData() + bomSize, m_data.size() - bomSize));
+
+    // The reader reports UTF-16 offsets. Elements come in document order, so one
+    // forward walk over the UTF-8 bytes turns them into byte offsets.
+    int charPos = 0;
+    int bytePos = bomSize;
+    auto toByteOffset = [&](int charOffset) {
+        while (charPos < charOffset && bytePos < m_data.size()) {
+            const uchar lead = uchar(m_data.at(bytePos));
+            const int bytes = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 1;
+            charPos += bytes == 4 ? 2 : 1;   // Outside the BMP: a surrogate pair
+            bytePos += bytes;
+        }
+        return charPos == charOffset ? bytePos : -1;
+    };
+    // Start of the open tag the reader is positioned right after, or -1. An offset
+    // that does not land on the tag (invalid UTF-8) leaves the message out.
+    auto openTagStart = [&](const char *tag) {
+        const int end = toByteOffset(int(xml.characterOffset()));
+        return end > 0 ? m_data.lastIndexOf(tag, end - 1) : -1;
+    };
+
+    m_types.append(QString());
+    Entry entry;
+    bool rootSeen = false;
+    bool inMessage = false;
+
+    while (!xml.atEnd()) {
+        xml.readNext();
+
+        if (xml.isStartElement()) {
+            const QStringRef name = xml.name();
+            if (!rootSeen) {
+                rootSeen = true;
+                m_language = xml.attributes().value("language").toString();
+                m_sourceLanguage = xml.attributes().value("sourcelanguage").toString();
+            } else if (name == QLatin1String("context")) {
+                m_contexts.append(QString());
+            } else if (name == QLatin1String("message")) {
+                inMessage = true;
+                entry = Entry();
+                entry.context = m_contexts.size() - 1;
+            } else if (!inMessage && name == QLatin1String("name") && !m_contexts.isEmpty()) {
+                m_contexts.last() = xml.readElementText();
+            } else if (inMessage && entry.source < 0 && name == QLatin1String("source")) {
+                entry.source = openTagStart("<source");
+                xml.skipCurrentElement();
+            } else if (inMessage && name == QLatin1String("comment")) {
+                entry.comment = openTagStart("<comment");
+                xml.skipCurrentElement();
+            } else if (inMessage && entry.length == 0 && name == QLatin1String("translation")) {
+                const QString type = xml.attributes().value("type").toString();
+                entry.type = m_types.indexOf(type);
+                if (entry.type < 0) {
+                    entry.type = m_types.size();
+                    m_types.append(type);
+                }
+                entry.offset = openTagStart("<translation");
+                entry.length = entry.offset >= 0 ? elementLength(entry.offset) : 0;
+                xml.skipCurrentElement();
+            }
+        } else if (xml.isEndElement() && xml.name() == QLatin1String("message")) {
+            if (entry.source >= 0 && entry.length > 0) {
+                m_entries.append(entry);
+            }
+            inMessage = false;
+        }
+    }
+
+    if (xml.hasError()) {
+        if (errorString) {
+            *errorString = QString("XML Parse error: %1 at line %2 col %3")
+                               .arg(xml.errorString()).arg(xml.lineNumber()).arg(xml.columnNumber());
+        }
+        return false;
+    }
+    return true;
+}
+
+QString TsDocument::elementText(int offset) const
+{
+    const int tagEnd = openTagEnd(offset);
+    const int length = elementLength(offset);
+    if (tagEnd < 0 || length <= 0 || m_data.at(tagEnd - 1) == '/') return QString();
+
+    // Plain text (the common case) is the bytes between the tags; entities, child
+    // elements and CR line ends go through the reader for XML's decoding rules
+    const int textEnd = m_data.lastIndexOf("</", offset + length - 1);
+    const char *begin = m_data.constData() + tagEnd + 1;
+    const char *end = m_data.constData() + textEnd;
+    if (std::none_of(begin, end, [](char ch) { return ch == '&' || ch == '<' || ch == '\r'; })) {
+        return QString::fromUtf8(begin, int(end - begin));
+    }
+    QXmlStreamReader xml(QByteArray::fromRawData(m_data.constData() + offset, length));
+    while (!xml.atEnd() && !xml.isStartElement()) {
+        xml.readNext();
+    }
+    return xml.readElementText(QXmlStreamReader::IncludeChildElements);
+}
+
+int TsDocument::openTagEnd(int offset) const
+{
+    // Skip '>' inside quoted attribute values
+    char quote = 0;
+    for (int i = offset + 1; i < m_data.size(); ++i) {
+        const char ch = m_data.at(i);
+        if (quote) {
+            if (ch == quote) quote = 0;
+        } else if (ch == '"' || ch == '\'') {
+            quote = ch;
+        } else if (ch == '>') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int TsDocument::elementLength(int offset) const
+{
+    const int tagEnd = openTagEnd(offset);
+    if (tagEnd < 0) return 0;
+    if (m_data.at(tagEnd - 1) == '/') {
+        return tagEnd + 1 - offset;
+    }
+
+    int nameEnd = offset + 1;
+    while (nameEnd < tagEnd && !QChar::fromLatin1(m_data.at(nameEnd)).isSpace() && m_data.at(nameEnd) != '/') {
+        ++nameEnd;
+    }
+    const QByteArray closeTag = "</" + m_data.mid(offset + 1, nameEnd - offset - 1) + ">";
+    const int closeStart = m_data.indexOf(closeTag, tagEnd);
+    if (closeStart < 0) return 0;
+    return closeStart + closeTag.size() - offset;
+}
+
+QByteArray TsDocument::finishedOpenTag(int offset) const
+{
+    static const QRegularExpression typeAttr(R"(\s+type\s*=\s*("[^"]*"|'[^']*'))");
+
+    QString tag = QString::fromUtf8(m_data.mid(offset, openTagEnd(offset) + 1 - offset));
+    tag.remove(typeAttr);
+
+    if (tag.endsWith(QLatin1String("/>"))) {
+        tag.chop(2);
+        while (tag.endsWith(' ')) tag.chop(1);
+        tag += '>';
+    }
+    return tag.toUtf8();
+}
+
+QByteArray TsDocument::serialize(const QHash<int, QString> &translations) const
+{
+    QVector<int> offsets;
+    offsets.reserve(translations.size());
+    for (auto it = translations.constBegin(); it != translations.constEnd(); ++it) {
+        offsets.append(it.key());
+    }
+    std::sort(offsets.begin(), offsets.end());
+
+    QByteArray out;
+    out.reserve(m_data.size() + m_data.size() / 4);
+    int pos = 0;
+    auto entry = m_entries.constBegin();
+    for (int offset : offsets) {
+        // Both lists are sorted, so the element lengths come from one merge walk
+        while (entry != m_entries.constEnd() && entry->offset < offset) ++entry;
+        if (entry == m_entries.constEnd() || entry->offset != offset || offset < pos) continue;
+
+        out.append(m_data.constData() + pos, offset - pos);
+        out += finishedOpenTag(offset);
+        out += escapeXml(translations.value(offset)).toUtf8();
+        out += "</translation>";
+        pos = offset + entry->length;
+    }
+    out.append(m_data.constData() + pos, m_data.size() - pos);
+    return out;
+}
+
+bool TsDocument::save(const QString &filePath, const QHash<int, QString> &translations, QString *errorString) const
+{
+    // Written to a temporary file and renamed over the target on commit(), so readers
+    // and crashes only ever see the old or the complete new file
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) *errorString = "Failed to save file: " + filePath + " (" + file.errorString() + ")";
+        return false;
+    }
+    const QByteArray data = serialize(translations);
+    if (file.write(data) != data.size() || !file.commit()) {
+        if (errorString) *errorString = "Failed to save file: " + filePath + " (" + file.errorString() + ")";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef TSDOCUMENT_H
+#define TSDOCUMENT_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+// Lightweight view of a Qt Linguist .ts file.
+//
+// Instead of building a DOM, the document keeps the raw file bytes plus a compact
+// index of byte offsets built by a single QXmlStreamReader pass at load time. scan()
+// decodes each message from its offsets as it is visited, so callers only keep the
+// messages they actually translate. Saving copies the original bytes through
+// unchanged and patches just the translated elements.
+class TsDocument {
+public:
+    struct Message {
+        QString context;
+        QString source;
+        QString comment; // Disambiguation <comment>, empty if none
+        QString translation;
+        QString type;    // <translation type="...">: "unfinished", "vanished", ...
+        int offset = -1; // Byte offset of "<translation" in the file
+        int length = 0;  // Bytes of the complete <translation> element
+    };
+
+    TsDocument();
+
+    bool load(const QString &filePath, QString *errorString = nullptr);
+    bool setContent(const QByteArray &data, QString *errorString = nullptr);
+    void clear();
+
+    bool isNull() const;
+    QString filePath() const;
+    // <TS language="..."> and <TS sourcelanguage="...">
+    QString language() const;
+    QString sourceLanguage() const;
+
+    // Visits all messages in document order. The visitor returns false to stop early.
+    // The document was validated by load(), so there is nothing left to fail.
+    void scan(const std::function<bool(const Message &)> &visitor) const;
+
+    // Document text with the given translations (keyed by Message::offset) patched in
+    QByteArray serialize(const QHash<int, QString> &translations) const;
+    bool save(const QString &filePath, const QHash<int, QString> &translations, QString *errorString = nullptr) const;
+
+private:
+    // Offsets of a message with a source and translation; 24 bytes however long its text
+    struct Entry {
+        int context = -1;   // Index in m_contexts
+        int type = 0;       // Index in m_types
+        int source = -1;    // Byte offset of "<source"
+        int comment = -1;   // Byte offset of "<comment", -1 if none
+        int offset = -1;    // Byte offset of "<translation"
+        int length = 0;     // Bytes of the complete <translation> element
+    };
+
+    // Indexes all messages into m_entries; false on malformed XML
+    bool parse(QString *errorString);
+    // Text content of the element starting at offset, decoded from the file bytes
+    QString elementText(int offset) const;
+    // Index of the '>' closing the open tag that starts at offset, or -1
+    int openTagEnd(int offset) const;
+    // Length of the element starting at offset (open tag through matching close tag)
+    int elementLength(int offset) const;
+    // "<translation ...>" with the type attribute removed and never self-closing
+    QByteArray finishedOpenTag(int offset) const;
+
+    QByteArray m_data;          // File bytes as read, BOM included
+    QVector<Entry> m_entries;   // In document order, so sorted by offset
+    QStringList m_contexts;     // Context names, once each
+    QStringList m_types;        // Distinct <translation type="..."> values, "" first
+    QString m_filePath;
+    QString m_language;
+    QString m_sourceLanguage;
+};
+
+#endif // TSDOCUMENT_H
@@ -4,6 +4,8 @@
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    // Used by QStandardPaths for the translation memory location
+    a.setApplicationName("LLMTranslator");
     
     MainWindow w;
     w.show();
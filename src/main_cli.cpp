@@ -0,0 +1,219 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QTextStream>
+#include "TranslatorEngine.h"
+
+// Headless entry point: translates any number of .ts files into one or more
+// languages in a single process, sharing the engine (network manager and
+// translation memory) across all jobs.
+
+namespace {
+QTextStream &err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// Expands "dir/*.ts" style arguments; plain paths are passed through
+QStringList expandInputs(const QStringList &args)
+{
+    QStringList files;
+    for (const QString &arg : args) {
+        QFileInfo info(arg);
+        const QString name = info.fileName();
+        if (name.contains('*') || name.contains('?') || name.contains('[')) {
+            QDir dir = info.dir();
+            for (const QFileInfo &match : dir.entryInfoList(QStringList(name), QDir::Files, QDir::Name)) {
+                files.append(match.filePath());
+            }
+        } else {
+            files.append(arg);
+        }
+    }
+    files.removeDuplicates();
+    return files;
+}
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // Same name as the GUI so both share the translation memory
+    app.setApplicationName("LLMTranslator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Translates Qt .ts files with a local Ollama model.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("files", "Input .ts files or globs (e.g. translations/*.ts).", "files...");
+
+    QCommandLineOption langOption({"l", "lang"}, "Comma-separated target languages.", "languages");
+    QCommandLineOption projectOption("project",
+        "Translate every .ts file below a directory into its own <TS language> and write it back in place; "
+        "strings shared by several files are translated once. --lang then selects the languages.", "dir");
+    QCommandLineOption apiOption("api",
+        "Ollama API URL. Repeat the option or separate with commas to spread the work over several servers; "
+        "each entry may be url|model|slots.", "url", "http://localhost:11434/api/generate");
+    QCommandLineOption modelOption({"m", "model"}, "Model name.", "model", "qwen3:14b");
+    QCommandLineOption concurrencyOption({"j", "concurrency"}, "Concurrent batch requests.", "n", "4");
+    QCommandLineOption contextOption("context", "Model context window in tokens.", "tokens", "8192");
+    QCommandLineOption retriesOption("retries", "Retries per batch for transient network errors and per "
+        "item missing from an answer.", "n", "5");
+    QCommandLineOption outputOption({"o", "output"},
+        "Output path pattern with {dir}, {name} and {lang}. Default: the input file itself for a single "
+        "language, {dir}/{name}_{lang}.ts otherwise.", "pattern");
+    QCommandLineOption retranslateOption("retranslate-all", "Translate finished messages too.");
+    QCommandLineOption streamOption("stream", "Use streaming responses.");
+    QCommandLineOption prefixOption("prefix-cache",
+        "Send batches to /api/chat with a fixed system prompt so the server can reuse the evaluated prefix.");
+    QCommandLineOption keepAliveOption("keep-alive", "How long the server keeps the model loaded after each request and the warm-up.",
+        "duration", "30m");
+    QCommandLineOption noMemoryOption("no-memory", "Do not use the translation memory.");
+    QCommandLineOption noSnapshotOption("no-snapshot",
+        "Do not compare against the snapshot of the last save; translate what the file marks unfinished.");
+    QCommandLineOption memoryOption("memory", "Translation memory file.", "path");
+    QCommandLineOption metricsOption("metrics",
+        "Write the per-batch metrics of every file as JSON; {dir} and {name} are replaced.", "pattern");
+    QCommandLineOption prometheusOption("metrics-prom",
+        "Write the same metrics in Prometheus text format; {dir} and {name} are replaced.", "pattern");
+    QCommandLineOption escalateOption("escalate-model",
+        "Translate results that fail the local checks again with this (larger) model.", "model");
+    QCommandLineOption noFuzzyOption("no-fuzzy",
+        "Do not reuse or show as examples the translations already finished in the file.");
+    QCommandLineOption autosaveOption("autosave",
+        "Write the output files every n batches (and at least once a minute) while translating.", "n");
+    QCommandLineOption quietOption({"q", "quiet"}, "Only print errors and a summary.");
+    QCommandLineOption verboseOption({"v", "verbose"}, "Also print per-batch details and raw model output.");
+    parser.addOptions({langOption, projectOption, apiOption, modelOption, concurrencyOption, contextOption, retriesOption,
+                       outputOption, retranslateOption, streamOption, prefixOption, keepAliveOption, noMemoryOption,
+                       noSnapshotOption, memoryOption, metricsOption, prometheusOption, escalateOption, noFuzzyOption, autosaveOption, quietOption, verboseOption});
+    parser.process(app);
+
+    const QStringList files = expandInputs(parser.positionalArguments());
+    QStringList languages;
+    for (const QString &lang : parser.value(langOption).split(',', QString::SkipEmptyParts)) {
+        languages.append(lang.trimmed());
+    }
+    if (!parser.isSet(projectOption) && (files.isEmpty() || languages.isEmpty())) {
+        err() << "Error: at least one input file and one target language (--lang), or --project, are required." << endl;
+        parser.showHelp(1);
+    }
+
+    QString pattern = parser.value(outputOption);
+    if (pattern.isEmpty()) {
+        pattern = languages.size() == 1 ? QString() : QString("{dir}/{name}_{lang}.ts");
+    }
+
+    TranslatorEngine engine;
+    if (parser.isSet(quietOption)) {
+        engine.setLogLevel(TranslatorEngine::LogError);
+    } else if (parser.isSet(verboseOption)) {
+        engine.setLogLevel(TranslatorEngine::LogDebug);
+    }
+    engine.setMaxConcurrency(parser.value(concurrencyOption).toInt());
+    engine.setContextSize(parser.value(contextOption).toInt());
+    engine.setMaxRetries(parser.value(retriesOption).toInt());
+    engine.setStreamingEnabled(parser.isSet(streamOption));
+    engine.setPrefixCacheEnabled(parser.isSet(prefixOption));
+    engine.setKeepAlive(parser.value(keepAliveOption));
+    engine.setTranslationMemoryEnabled(!parser.isSet(noMemoryOption));
+    engine.setSnapshotEnabled(!parser.isSet(noSnapshotOption));
+    engine.setFuzzyMatchingEnabled(!parser.isSet(noFuzzyOption));
+    engine.setEscalationModel(parser.value(escalateOption));
+    if (parser.isSet(memoryOption)) {
+        engine.setTranslationMemoryPath(parser.value(memoryOption));
+    }
+
+    QString currentJob;
+    bool jobFailed = false;
+    QObject::connect(&engine, &TranslatorEngine::logMessage, [&](const QString &msg, TranslatorEngine::LogLevel level) {
+        if (level <= engine.logLevel()) err() << "[" << currentJob << "] " << msg << endl;
+    });
+    QObject::connect(&engine, &TranslatorEngine::errorOccurred, [&](const QString &msg) {
+        err() << "[" << currentJob << "] ERROR: " << msg << endl;
+        jobFailed = true;
+    });
+
+    // Runs the loaded file(s) to completion; translationFinished may already be emitted
+    // inside startTranslation
+    auto translate = [&](const QString &input) {
+        bool finished = false;
+        QEventLoop loop;
+        QMetaObject::Connection connection = QObject::connect(&engine, &TranslatorEngine::translationFinished, [&]() {
+            finished = true;
+            loop.quit();
+        });
+        engine.startTranslation(languages, parser.values(apiOption).join(','), parser.value(modelOption),
+                                parser.isSet(retranslateOption));
+        if (!finished) {
+            loop.exec();
+        }
+        QObject::disconnect(connection);
+
+        QString error;
+        if (parser.isSet(metricsOption)
+            && !engine.metrics().writeJson(TranslatorEngine::outputPath(parser.value(metricsOption), input, QString()), &error)) {
+            err() << "[" << currentJob << "] " << error << endl;
+        }
+        if (parser.isSet(prometheusOption)
+            && !engine.metrics().writePrometheus(TranslatorEngine::outputPath(parser.value(prometheusOption), input, QString()), &error)) {
+            err() << "[" << currentJob << "] " << error << endl;
+        }
+    };
+
+    // Parsing below runs without an event loop; one pass hands the warm-up request to the
+    // network thread, so the server loads the model while the input is parsed
+    engine.warmUp(parser.values(apiOption).join(','), parser.value(modelOption));
+    QCoreApplication::processEvents();
+
+    if (parser.isSet(projectOption)) {
+        // One run over all files, so shared strings are deduplicated across the project
+        const QString dir = QDir(parser.value(projectOption)).absolutePath();
+        currentJob = QFileInfo(dir).fileName();
+        if (!engine.loadProject(dir)) {
+            return 1;
+        }
+        if (parser.isSet(autosaveOption)) {
+            engine.setAutosave("{dir}/{name}.ts", parser.value(autosaveOption).toInt());
+        }
+        translate(dir);
+        const bool saved = engine.saveProject();
+        err() << "[" << currentJob << "] " << (jobFailed || !saved ? "finished with errors, " : "done, ")
+              << engine.targetLanguages().size() << " files written in place." << endl;
+        return jobFailed || !saved ? 1 : 0;
+    }
+
+    int failures = 0;
+    for (const QString &file : files) {
+        // Each file is parsed once and translated into all languages in one run
+        currentJob = QFileInfo(file).fileName();
+        jobFailed = false;
+
+        if (!engine.loadFile(file)) {
+            failures += languages.size();
+            continue;
+        }
+        if (parser.isSet(autosaveOption)) {
+            // Same targets as the final save below
+            engine.setAutosave(pattern.isEmpty() ? file : pattern, parser.value(autosaveOption).toInt());
+        }
+
+        translate(file);
+
+        for (const QString &lang : languages) {
+            const QString target = pattern.isEmpty() ? file : TranslatorEngine::outputPath(pattern, file, lang);
+            if (!engine.saveFile(target, lang) || jobFailed) {
+                failures++;
+            }
+            err() << "[" << currentJob << " -> " << lang << "] " << (jobFailed ? "finished with errors, " : "done, ")
+                  << "written to " << QDir::toNativeSeparators(target) << endl;
+        }
+    }
+
+    err() << files.size() * languages.size() - failures << " of " << files.size() * languages.size()
+          << " jobs succeeded." << endl;
+    return failures == 0 ? 0 : 1;
+}